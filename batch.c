@@ -0,0 +1,667 @@
+/* Programmed by edutavr */
+
+/* Batch self-play: plays many independent games with a bot on every core
+   and prints aggregate stats. Needs only the engine (./build.sh batch).
+
+   rayblocks_batch [-n games] [-j workers] [-r ruleset] [-b bot] [-s seed]
+                   [-l level] [-p max pieces] [-W width] [-H height]
+                   [-x bot command]
+
+   Game i plays seed + i, so a run's results (and its checksum) depend only
+   on its options, never on the worker count or on scheduling.
+
+   With -x, placements come from an external bot instead: every worker
+   starts the command and talks to it over its stdin/stdout, one message
+   per line (see BOT PROCESS below). */
+
+#include "engine.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+
+/* ===================== CONFIG ===================== */
+
+#define DEFAULT_GAMES       1000
+#define DEFAULT_MAX_PIECES  10000
+#define DEFAULT_WORKERS     4      /* when the core count is unknown */
+#define MAX_WORKERS         256
+#define TICKS_PER_PIECE_CAP 1000   /* a game needing more ticks than this per piece is cut short */
+#define BOT_LANES           8      /* games in flight per worker with an external bot */
+#define BOT_LINE_MAX        64     /* longest reply line */
+
+/* ===================== TYPES ===================== */
+
+typedef struct BatchConfig {
+  long      games;
+  int       workers;
+  RulesetId ruleset;
+  int       bot;          /* index into BOT_POLICIES */
+  uint64_t  seed;         /* game i plays seed + i */
+  int       startLevel;
+  int       cols;         /* walls and floor included */
+  int       rows;
+  long      maxPieces;
+  const char *botCommand; /* external bot, NULL = the built-in one */
+} BatchConfig;
+
+/* One game's bot: the placement chosen for the current piece and the taps
+   still needed to reach it. Buttons are tapped (pressed one tick, released
+   the next) so every move is a fresh press. */
+typedef struct Bot {
+  bool        planned;
+  int         targetRot;
+  int         targetX;
+  bool        tapped;     /* a tap was made for this piece... */
+  ActivePiece tapPose;    /* ...from this pose, to notice a blocked path */
+  unsigned    lastInput;
+  uint64_t    rng;
+} Bot;
+
+typedef struct BotPolicy {
+  const char *name;
+  void (*plan)(Bot *b, const GameState *g, const ActivePiece *p);
+} BotPolicy;
+
+/* Games [begin, end) a worker still owes, packed in one word so the owner
+   (taking from the front) and thieves (taking the back half) settle every
+   race with a single compare-and-swap. Padded to its own cache line. */
+typedef struct WorkRange {
+  _Alignas(64) _Atomic uint64_t range;
+} WorkRange;
+
+/* Pipes to one external bot process. */
+typedef struct BotLink {
+  FILE *to;
+  FILE *from;
+  pid_t pid;
+} BotLink;
+
+/* One game a worker is playing, with its bot. */
+typedef struct Lane {
+  GameState *g;
+  Bot        bot;
+  uint32_t   index;
+  int        startLines;
+  long       pieces;
+  long       ticks;
+  bool       active;      /* a game is in progress */
+  bool       waiting;     /* a placement was asked for and not read yet */
+} Lane;
+
+typedef struct WorkerStats {
+  long     games;
+  long     pieces;
+  long     lines;
+  long     ticks;
+  long     steals;
+  uint64_t checksum;
+} WorkerStats;
+
+typedef struct Worker {
+  int         id;
+  pthread_t   thread;
+  BotLink     link;
+  WorkerStats stats;
+} Worker;
+
+/* ===================== GLOBAL STATE ===================== */
+
+static BatchConfig cfg = {
+  .games      = DEFAULT_GAMES,
+  .workers    = 0,
+  .ruleset    = RULESET_RAYBLOCKS,
+  .bot        = 0,
+  .seed       = 1,
+  .startLevel = 1,
+  .cols       = 10 + 2,
+  .rows       = 20 + 1,
+  .maxPieces  = DEFAULT_MAX_PIECES,
+};
+
+static WorkRange ranges[MAX_WORKERS];
+static Worker    workers[MAX_WORKERS];
+static int      *gameScores;   /* final score of game i, for the distribution */
+static GameStepFn stepGame;    /* GameStepFor(cfg.ruleset) */
+
+/* ===================== BOTS ===================== */
+
+static uint64_t BotRandom(Bot *b) {
+  b->rng ^= b->rng >> 12;
+  b->rng ^= b->rng << 25;
+  b->rng ^= b->rng >> 27;
+  return b->rng * 0x2545F4914F6CDD1Dull;
+}
+
+/* Columns x covered by placing cells at x: [x + lo, x + hi]. */
+static void CellSpan(const int cells[4][2], int *lo, int *hi) {
+  *lo = *hi = cells[0][0];
+  for (int i = 1; i < 4; i++) {
+    if (cells[i][0] < *lo) *lo = cells[i][0];
+    if (cells[i][0] > *hi) *hi = cells[i][0];
+  }
+}
+
+/* Piece y after a straight drop at x onto columns of the given heights. */
+static int LandingY(const GameState *g, const int height[], const int cells[4][2], int x) {
+  int land = GameRows(g);
+  for (int i = 0; i < 4; i++) {
+    int y = GameRows(g)-2 - height[x + cells[i][0]] - cells[i][1];
+    if (y < land) land = y;
+  }
+  return land;
+}
+
+/* Aggregate height, cleared lines, new holes and bumpiness after a straight
+   drop at x, weighted as in Yiyuan Lee's tuned Tetris heuristic. */
+static double EvaluatePlacement(const GameState *g, const int height[], const int cells[4][2], int x) {
+  int cols = GameCols(g), rows = GameRows(g);
+  int land = LandingY(g, height, cells, x);
+  int after[MAX_BOARD_COLS];
+  memcpy(after, height, (size_t)cols * sizeof(int));
+
+  int lines = 0, holes = 0;
+  for (int i = 0; i < 4; i++) {
+    int gx = x + cells[i][0], gy = land + cells[i][1];
+    if (gy < 0) return -1e9;  /* would lock above the field */
+    if (rows-1 - gy > after[gx]) after[gx] = rows-1 - gy;
+
+    bool lowest = true, firstInRow = true;
+    int inRow = 0;
+    for (int j = 0; j < 4; j++) {
+      if (cells[j][0] == cells[i][0] && cells[j][1] > cells[i][1]) lowest = false;
+      if (cells[j][1] == cells[i][1]) { inRow++; if (j < i) firstInRow = false; }
+    }
+    if (lowest) holes += (rows-2 - height[gx]) - gy;
+    if (firstInRow && RowCellCount(g, gy) + inRow == cols-2) lines++;
+  }
+
+  int aggregate = 0, bumpiness = 0;
+  for (int c = 1; c < cols-1; c++) {
+    aggregate += after[c] - lines;
+    if (c > 1) bumpiness += abs(after[c] - after[c-1]);
+  }
+  return -0.510066 * aggregate + 0.760666 * lines - 0.35663 * holes - 0.184483 * bumpiness;
+}
+
+/* Best straight drop by EvaluatePlacement; ties keep the first found. */
+static void PlanHeuristic(Bot *b, const GameState *g, const ActivePiece *p) {
+  int cols = GameCols(g);
+  int height[MAX_BOARD_COLS];
+  for (int x = 0; x < cols; x++) height[x] = ColumnHeight(g, x);
+  double best = -1e300;
+  b->targetRot = p->rot;
+  b->targetX   = p->x;
+  for (int rot = 0; rot < 4; rot++) {
+    int cells[4][2], lo, hi;
+    PieceCells(p->type, rot, cells);
+    CellSpan(cells, &lo, &hi);
+    for (int x = 1 - lo; x + hi <= cols-2; x++) {
+      double s = EvaluatePlacement(g, height, cells, x);
+      if (s > best) { best = s; b->targetRot = rot; b->targetX = x; }
+    }
+  }
+}
+
+/* Any orientation and column, uniformly: a floor for the heuristic. */
+static void PlanRandom(Bot *b, const GameState *g, const ActivePiece *p) {
+  int cells[4][2], lo, hi;
+  b->targetRot = (int)(BotRandom(b) & 3);
+  PieceCells(p->type, b->targetRot, cells);
+  CellSpan(cells, &lo, &hi);
+  int first = 1 - lo, count = (GameCols(g)-2 - hi) - first + 1;
+  b->targetX = first + (int)(BotRandom(b) % (uint64_t)count);
+}
+
+static const BotPolicy BOT_POLICIES[] = {
+  { "heuristic", PlanHeuristic },
+  { "random",    PlanRandom    },
+};
+#define BOT_POLICY_COUNT ((int)(sizeof(BOT_POLICIES) / sizeof(BOT_POLICIES[0])))
+
+/* Buttons for the next tick: rotate, then shift, then hard drop, one tap at
+   a time. A tap that changed nothing means the way is blocked, and the
+   piece is dropped where it is. */
+static unsigned BotInput(Bot *b, const GameState *g) {
+  ActivePiece p;
+  if (!GameCurrentPiece(g, &p)) return b->lastInput = 0;
+  if (!b->planned) {
+    BOT_POLICIES[cfg.bot].plan(b, g, &p);
+    b->planned = true;
+    b->tapped  = false;
+  } else if (b->lastInput) {
+    return b->lastInput = 0;
+  }
+
+  unsigned input;
+  bool stuck = b->tapped && p.rot == b->tapPose.rot && p.x == b->tapPose.x;
+  if (stuck)                     input = INPUT_HARD_DROP;
+  else if (p.rot != b->targetRot) input = ((b->targetRot - p.rot) & 3) == 3 ? INPUT_ROTATE_CCW : INPUT_ROTATE_CW;
+  else if (p.x < b->targetX)     input = INPUT_RIGHT;
+  else if (p.x > b->targetX)     input = INPUT_LEFT;
+  else                           input = INPUT_HARD_DROP;
+  b->tapped  = true;
+  b->tapPose = p;
+  return b->lastInput = input;
+}
+
+/* ===================== WORK STEALING ===================== */
+
+static inline uint64_t PackRange(uint32_t begin, uint32_t end) {
+  return ((uint64_t)begin << 32) | end;
+}
+
+/* Owner side: the next game from the front of its own range. */
+static bool TakeGame(WorkRange *w, uint32_t *game) {
+  uint64_t r = atomic_load(&w->range);
+  for (;;) {
+    uint32_t begin = (uint32_t)(r >> 32), end = (uint32_t)r;
+    if (begin >= end) return false;
+    if (atomic_compare_exchange_weak(&w->range, &r, PackRange(begin + 1, end))) {
+      *game = begin;
+      return true;
+    }
+  }
+}
+
+/* Thief side: the back half of a victim's range, rounded up so a single
+   game left can be stolen too. */
+static bool StealGames(WorkRange *victim, uint32_t *begin, uint32_t *end) {
+  uint64_t r = atomic_load(&victim->range);
+  for (;;) {
+    uint32_t b = (uint32_t)(r >> 32), e = (uint32_t)r;
+    if (b >= e) return false;
+    uint32_t mid = e - (e - b + 1) / 2;
+    if (atomic_compare_exchange_weak(&victim->range, &r, PackRange(b, mid))) {
+      *begin = mid;
+      *end   = e;
+      return true;
+    }
+  }
+}
+
+/* Only an idle worker steals, and only into its own empty range, which no
+   thief can touch; once every range is empty the remaining games are all
+   being played and the worker is done. */
+static bool StealWork(Worker *w) {
+  for (int k = 1; k < cfg.workers; k++) {
+    uint32_t begin, end;
+    if (!StealGames(&ranges[(w->id + k) % cfg.workers], &begin, &end)) continue;
+    atomic_store(&ranges[w->id].range, PackRange(begin, end));
+    w->stats.steals++;
+    return true;
+  }
+  return false;
+}
+
+/* ===================== BOT PROCESS ===================== */
+
+/* Line protocol with an external bot, game side first:
+     rules <width> <height> <ruleset>    once; the bot answers ready <name>
+     new <lane> <seed>                   lane starts a new game
+     suggest <lane> <piece> <next> <board>
+     quit
+   piece and next are letters (IOTSZJL); board is the field's rows from the
+   top, '.' empty and '#' filled, joined by '/'. The bot answers each
+   suggest, in order, with
+     place <lane> <rot> <x>
+   rot as in PieceCells, x the field column (0 = leftmost) the piece's
+   cells are offset from. Requests for every lane waiting on a placement go
+   out in one write, so the bot works through them while the worker plays
+   the lanes it already has answers for. */
+
+static const char PIECE_LETTERS[TETROMINO_COUNT + 1] = "IOTSZJL";
+
+#ifndef _WIN32
+/* Runs command with its stdin/stdout on two pipes. Called before any worker
+   starts, and the game's pipe ends are close-on-exec, so a bot never holds
+   another bot's pipes open. */
+static bool OpenBotLink(BotLink *link, const char *command) {
+  int toBot[2], fromBot[2];
+  if (pipe(toBot) != 0) return false;
+  if (pipe(fromBot) != 0) { close(toBot[0]); close(toBot[1]); return false; }
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(toBot[0]); close(toBot[1]); close(fromBot[0]); close(fromBot[1]);
+    return false;
+  }
+  if (pid == 0) {
+    dup2(toBot[0], STDIN_FILENO);
+    dup2(fromBot[1], STDOUT_FILENO);
+    close(toBot[0]); close(toBot[1]); close(fromBot[0]); close(fromBot[1]);
+    execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+    _exit(127);
+  }
+  close(toBot[0]);
+  close(fromBot[1]);
+  fcntl(toBot[1], F_SETFD, FD_CLOEXEC);
+  fcntl(fromBot[0], F_SETFD, FD_CLOEXEC);
+  link->pid  = pid;
+  link->to   = fdopen(toBot[1], "w");
+  link->from = fdopen(fromBot[0], "r");
+  return link->to && link->from;
+}
+
+static void CloseBotLink(BotLink *link) {
+  if (link->to) { fprintf(link->to, "quit\n"); fclose(link->to); }
+  if (link->from) fclose(link->from);
+  if (link->pid > 0) waitpid(link->pid, NULL, 0);
+  memset(link, 0, sizeof *link);
+}
+#else
+static bool OpenBotLink(BotLink *link, const char *command) {
+  (void)link; (void)command;
+  fprintf(stderr, "external bots need fork() and pipes, not available on Windows\n");
+  return false;
+}
+
+static void CloseBotLink(BotLink *link) {
+  (void)link;
+}
+#endif
+
+static bool BotHandshake(BotLink *link) {
+  char line[BOT_LINE_MAX];
+  fprintf(link->to, "rules %d %d %s\n", cfg.cols - 2, cfg.rows - 1, RulesetName(cfg.ruleset));
+  fflush(link->to);
+  return fgets(line, sizeof line, link->from) && strncmp(line, "ready", 5) == 0;
+}
+
+static void SendSuggest(BotLink *link, int lane, const GameState *g) {
+  ActivePiece p;
+  GameCurrentPiece(g, &p);
+  fprintf(link->to, "suggest %d %c ", lane, PIECE_LETTERS[p.type]);
+  for (int i = 0; i < GamePreviewCount(g); i++) fputc(PIECE_LETTERS[QueuePeek(g, i)], link->to);
+  fputc(' ', link->to);
+  for (int y = 0; y < GameRows(g)-1; y++) {
+    if (y > 0) fputc('/', link->to);
+    for (int x = 1; x < GameCols(g)-1; x++) fputc(CellAt(g, x, y) == PLACED_PIECE ? '#' : '.', link->to);
+  }
+  fputc('\n', link->to);
+}
+
+/* The next reply, which must be for lane. */
+static bool ReadPlacement(BotLink *link, int lane, Bot *b) {
+  char line[BOT_LINE_MAX];
+  int replyLane, rot, x;
+  if (!fgets(line, sizeof line, link->from)) return false;
+  if (sscanf(line, "place %d %d %d", &replyLane, &rot, &x) != 3 || replyLane != lane) return false;
+  b->targetRot = rot & 3;
+  b->targetX   = x + 1;
+  b->planned   = true;
+  b->tapped    = false;
+  return true;
+}
+
+/* ===================== GAMES ===================== */
+
+static void StartGame(Lane *l, uint32_t index) {
+  uint64_t seed = cfg.seed + index;
+  l->bot = (Bot){ .rng = seed * 0x9E3779B97F4A7C15ull | 1 };
+  GameInit(l->g, seed, cfg.ruleset, cfg.startLevel);
+  l->index      = index;
+  l->startLines = GameLines(l->g);
+  l->pieces     = 0;
+  l->ticks      = 0;
+  l->active     = true;
+}
+
+static bool GameDone(const Lane *l) {
+  return GameIsOver(l->g) || l->pieces >= cfg.maxPieces || l->ticks >= cfg.maxPieces * TICKS_PER_PIECE_CAP;
+}
+
+/* A piece is in play and its bot has no placement for it yet. */
+static bool NeedsPlacement(const Lane *l) {
+  ActivePiece p;
+  return !l->bot.planned && GameCurrentPiece(l->g, &p);
+}
+
+static void TickGame(Lane *l) {
+  stepGame(l->g, BotInput(&l->bot, l->g));
+  l->ticks++;
+  if (GameEvents(l->g) & EVENT_LOCK) { l->pieces++; l->bot.planned = false; }
+}
+
+static void FinishGame(Lane *l, WorkerStats *st) {
+  const GameState *g = l->g;
+  gameScores[l->index] = GameScore(g);
+  st->games++;
+  st->pieces += l->pieces;
+  st->lines  += GameLines(g) - l->startLines;
+  st->ticks  += l->ticks;
+  st->checksum += GameHash(g) ^ ((uint64_t)GameScore(g) << 32 | l->index);
+  l->active = false;
+}
+
+static bool NextGame(Worker *w, uint32_t *index) {
+  for (;;) {
+    if (TakeGame(&ranges[w->id], index)) return true;
+    if (!StealWork(w)) return false;
+  }
+}
+
+static void PlayLocal(Worker *w, Lane *l) {
+  uint32_t index;
+  while (NextGame(w, &index)) {
+    StartGame(l, index);
+    while (!GameDone(l)) TickGame(l);
+    FinishGame(l, &w->stats);
+  }
+}
+
+/* Plays BOT_LANES games at once. Each round runs every lane up to its next
+   placement request, sends all new requests in one write, then reads one
+   reply (the oldest) and goes round again, so the bot always has the other
+   requests to work on. */
+static void PlayExternal(Worker *w, Lane lanes[BOT_LANES]) {
+  BotLink *link = &w->link;
+  int fifo[BOT_LANES], fifoHead = 0, fifoCount = 0;
+  if (!BotHandshake(link)) { fprintf(stderr, "worker %d: bot did not answer\n", w->id); exit(1); }
+  for (int i = 0; i < BOT_LANES; i++) {
+    uint32_t index;
+    if (!NextGame(w, &index)) break;
+    StartGame(&lanes[i], index);
+    fprintf(link->to, "new %d %llu\n", i, (unsigned long long)(cfg.seed + index));
+  }
+  for (;;) {
+    for (int i = 0; i < BOT_LANES; i++) {
+      Lane *l = &lanes[i];
+      while (l->active && !l->waiting) {
+        uint32_t index;
+        if (GameDone(l)) {
+          FinishGame(l, &w->stats);
+          if (NextGame(w, &index)) {
+            StartGame(l, index);
+            fprintf(link->to, "new %d %llu\n", i, (unsigned long long)(cfg.seed + index));
+          }
+        } else if (NeedsPlacement(l)) {
+          SendSuggest(link, i, l->g);
+          l->waiting = true;
+          fifo[(fifoHead + fifoCount++) % BOT_LANES] = i;
+        } else {
+          TickGame(l);
+        }
+      }
+    }
+    fflush(link->to);
+    if (fifoCount == 0) break;
+
+    int i = fifo[fifoHead];
+    fifoHead = (fifoHead + 1) % BOT_LANES;
+    fifoCount--;
+    if (!ReadPlacement(link, i, &lanes[i].bot)) {
+      fprintf(stderr, "worker %d: bad or missing reply from bot\n", w->id);
+      exit(1);
+    }
+    lanes[i].waiting = false;
+  }
+}
+
+static void *WorkerMain(void *arg) {
+  Worker *w = arg;
+  Lane lanes[BOT_LANES] = {0};
+  int laneCount = cfg.botCommand ? BOT_LANES : 1;
+  for (int i = 0; i < laneCount; i++) {
+    lanes[i].g = GameCreate(cfg.cols, cfg.rows);
+    if (!lanes[i].g) { fprintf(stderr, "worker %d: out of memory\n", w->id); exit(1); }
+  }
+  if (cfg.botCommand) PlayExternal(w, lanes);
+  else                PlayLocal(w, &lanes[0]);
+  for (int i = 0; i < laneCount; i++) GameDestroy(lanes[i].g);
+  return NULL;
+}
+
+/* ===================== REPORT ===================== */
+
+static int CompareInts(const void *a, const void *b) {
+  int x = *(const int *)a, y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+static double Seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void PrintReport(double seconds) {
+  WorkerStats total = {0};
+  for (int i = 0; i < cfg.workers; i++) {
+    const WorkerStats *s = &workers[i].stats;
+    total.games    += s->games;
+    total.pieces   += s->pieces;
+    total.lines    += s->lines;
+    total.ticks    += s->ticks;
+    total.steals   += s->steals;
+    total.checksum += s->checksum;
+  }
+  if (total.games == 0) { printf("no games played\n"); return; }
+
+  qsort(gameScores, (size_t)total.games, sizeof(int), CompareInts);
+  double scoreSum = 0.0;
+  for (long i = 0; i < total.games; i++) scoreSum += gameScores[i];
+  #define PCT(p) gameScores[(long)((total.games - 1) * (p) / 100)]
+
+  printf("%ld games, %s rules, %s bot, %d x %d board, %d workers (%ld steals)\n",
+         total.games, RulesetName(cfg.ruleset), cfg.botCommand ? cfg.botCommand : BOT_POLICIES[cfg.bot].name,
+         cfg.cols - 2, cfg.rows - 1, cfg.workers, total.steals);
+  printf("time      %10.2f s\n", seconds);
+  printf("games/s   %10.0f\n", total.games / seconds);
+  printf("pieces/s  %10.0f\n", total.pieces / seconds);
+  printf("ticks/s   %10.0f\n", total.ticks / seconds);
+  printf("score     mean %.0f  min %d  p10 %d  p50 %d  p90 %d  p99 %d  max %d\n",
+         scoreSum / total.games, gameScores[0], PCT(10), PCT(50), PCT(90), PCT(99), gameScores[total.games - 1]);
+  printf("lines     mean %.1f\n", (double)total.lines / total.games);
+  printf("pieces    mean %.1f\n", (double)total.pieces / total.games);
+  printf("checksum  %016llx\n", (unsigned long long)total.checksum);
+  #undef PCT
+}
+
+/* ===================== MAIN ===================== */
+
+static void Usage(void) {
+  fprintf(stderr,
+    "usage: rayblocks_batch [-n games] [-j workers] [-r ruleset] [-b bot] [-s seed]\n"
+    "                       [-l level] [-p max pieces] [-W width] [-H height]\n"
+    "                       [-x bot command]\n");
+  fprintf(stderr, "rulesets:");
+  for (int i = 0; i < RULESET_COUNT; i++) fprintf(stderr, " %s", RulesetName((RulesetId)i));
+  fprintf(stderr, "\nbots:");
+  for (int i = 0; i < BOT_POLICY_COUNT; i++) fprintf(stderr, " %s", BOT_POLICIES[i].name);
+  fprintf(stderr, "\n");
+  exit(2);
+}
+
+static bool ParseArgs(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    const char *opt = argv[i];
+    if (opt[0] != '-' || !opt[1] || opt[2] || i + 1 >= argc) return false;
+    const char *val = argv[++i];
+    switch (opt[1]) {
+      case 'n': cfg.games      = strtol(val, NULL, 10);        break;
+      case 'j': cfg.workers    = (int)strtol(val, NULL, 10);   break;
+      case 's': cfg.seed       = strtoull(val, NULL, 0);       break;
+      case 'l': cfg.startLevel = (int)strtol(val, NULL, 10);   break;
+      case 'p': cfg.maxPieces  = strtol(val, NULL, 10);        break;
+      case 'W': cfg.cols       = (int)strtol(val, NULL, 10) + 2; break;
+      case 'H': cfg.rows       = (int)strtol(val, NULL, 10) + 1; break;
+      case 'x': cfg.botCommand = val;                          break;
+      case 'r': {
+        int r = 0;
+        while (r < RULESET_COUNT && strcasecmp(val, RulesetName((RulesetId)r)) != 0) r++;
+        if (r == RULESET_COUNT) return false;
+        cfg.ruleset = (RulesetId)r;
+      } break;
+      case 'b': {
+        int b = 0;
+        while (b < BOT_POLICY_COUNT && strcasecmp(val, BOT_POLICIES[b].name) != 0) b++;
+        if (b == BOT_POLICY_COUNT) return false;
+        cfg.bot = b;
+      } break;
+      default: return false;
+    }
+  }
+  return cfg.games > 0 && cfg.games <= UINT32_MAX && cfg.startLevel >= 1 && cfg.maxPieces > 0
+      && cfg.cols >= 6 && cfg.cols <= MAX_BOARD_COLS && cfg.rows >= 6 && cfg.rows <= MAX_BOARD_ROWS;
+}
+
+int main(int argc, char **argv) {
+  if (!ParseArgs(argc, argv)) Usage();
+  if (cfg.workers <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+    cfg.workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (cfg.workers <= 0) cfg.workers = DEFAULT_WORKERS;
+  }
+  if (cfg.workers > MAX_WORKERS)  cfg.workers = MAX_WORKERS;
+  if (cfg.workers > cfg.games)    cfg.workers = (int)cfg.games;
+
+  gameScores = malloc((size_t)cfg.games * sizeof(int));
+  if (!gameScores) { fprintf(stderr, "out of memory\n"); return 1; }
+  EngineInit();
+  stepGame = GameStepFor(cfg.ruleset);
+
+  /* Even split up front; stealing evens out games of different lengths. */
+  for (int i = 0; i < cfg.workers; i++) {
+    uint32_t begin = (uint32_t)(cfg.games * i / cfg.workers);
+    uint32_t end   = (uint32_t)(cfg.games * (i + 1) / cfg.workers);
+    atomic_store(&ranges[i].range, PackRange(begin, end));
+    workers[i].id = i;
+  }
+
+  /* Bot processes start here, before any thread, so none inherits another's pipes. */
+  if (cfg.botCommand) {
+#ifndef _WIN32
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    for (int i = 0; i < cfg.workers; i++)
+      if (!OpenBotLink(&workers[i].link, cfg.botCommand)) {
+        fprintf(stderr, "could not start bot: %s\n", cfg.botCommand);
+        return 1;
+      }
+  }
+
+  double t0 = Seconds();
+  for (int i = 0; i < cfg.workers; i++)
+    if (pthread_create(&workers[i].thread, NULL, WorkerMain, &workers[i]) != 0) {
+      fprintf(stderr, "could not start worker %d\n", i);
+      return 1;
+    }
+  for (int i = 0; i < cfg.workers; i++) pthread_join(workers[i].thread, NULL);
+  PrintReport(Seconds() - t0);
+  for (int i = 0; i < cfg.workers; i++) CloseBotLink(&workers[i].link);
+
+  free(gameScores);
+  return 0;
+}
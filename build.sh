@@ -1,5 +1,33 @@
 #!/bin/bash
 
-gcc -o rayblocks.exe main.c  -I include -L lib -lraylib -lgdi32 -lwinmm -mwindows -ggdb
+# Engine only: static library for headless use (no raylib, window or audio).
+if [ "$1" = "engine" ]; then
+  gcc -O2 -c engine.c -o engine.o
+  ar rcs librayblocks.a engine.o
+  exit
+fi
+
+# Engine only: shared library with the stable C ABI of engine.h, for bindings.
+if [ "$1" = "shared" ]; then
+  gcc -O2 -shared -fPIC -o librayblocks.so engine.c
+  exit
+fi
+
+if [ "$1" = "bench" ]; then
+  gcc -O2 -o rayblocks_bench engine.c -DRAYBLOCKS_BENCH
+  ./rayblocks_bench
+  exit
+fi
+
+# Bot self-play on every core, e.g. ./build.sh batch -n 10000 -r NES
+if [ "$1" = "batch" ]; then
+  shift
+  gcc -O2 -o rayblocks_batch batch.c engine.c -lpthread
+  gcc -O2 -o rayblocks_refbot refbot.c engine.c
+  ./rayblocks_batch "$@"
+  exit
+fi
+
+gcc -o rayblocks.exe main.c engine.c replay.c  -I include -L lib -lraylib -lgdi32 -lwinmm -lpthread -mwindows -ggdb
 
 ./rayblocks.exe
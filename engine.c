@@ -0,0 +1,1456 @@
+/* Programmed by edutavr */
+
+#include "engine.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef RAYBLOCKS_BENCH
+#include <stdio.h>
+#include <time.h>
+#endif
+
+/* ===================== CONFIG ===================== */
+
+#define LEFT  -1
+#define RIGHT  1
+#define ROT_CW   1
+#define ROT_CCW -1
+#define ROWS_PER_SECOND(n) ((n) * GRAVITY_ONE / SIM_TICK_RATE)
+#define TICKS_PER_ROW(n)   (GRAVITY_ONE / (n))
+#define LINE_CLEAR_BLINK_EVERY   6
+
+/* Soft drop starts repeating right away, every sdArr ticks of the game's
+   handling (see GameSetHandling). */
+static const int SD_DAS_TICKS = 0;
+
+/* ===================== TYPES ===================== */
+
+/* Board occupancy: one bitmask per row, bit (x + BOARD_MARGIN) = cell x,
+   spread over rowWords 64-bit words. Walls, the floor row, the margin bits
+   and the unused tail of the last word are fixed set bits. */
+typedef uint64_t RowWord;
+#define BOARD_MARGIN 4
+
+/* Spare rows kept around the field so a 4-row piece mask can always be
+   tested without bounds checks: empty rows above, full rows below. */
+#define BOARD_PAD_TOP    4
+#define BOARD_PAD_BOTTOM 3
+
+/* Piece masks cover piece rows y-1..y+2; cell dx sits at pattern bit
+   dx + MASK_X_BIAS, so a placement at x starts at row bit x + MASK_X_BIAS. */
+#define MASK_ROWS    4
+#define MASK_X_BIAS  2
+
+_Static_assert(BOARD_MARGIN == 2*MASK_X_BIAS, "piece masks assume the row margin");
+
+/* How upcoming pieces are dealt. */
+typedef enum Randomizer {
+  RANDOMIZER_BAG7,    /* each run of 7 pieces is a shuffled full set */
+  RANDOMIZER_REROLL,  /* uniform, rolled once more on a repeat */
+  RANDOMIZER_PURE,    /* uniform */
+  RANDOMIZER_COUNT
+} Randomizer;
+
+#define RULESET_MAX_LEVELS 48
+
+/* Scoring, speed and timing rules of one game mode. Tables, not code: the
+   engine reads them only through a constant pointer. */
+typedef struct Ruleset {
+  const char *name;
+  int levelCount;                        /* levels with their own gravity; later ones reuse the last */
+  int levelGravity[RULESET_MAX_LEVELS];  /* GRAVITY_ONE units per tick, from level 1 */
+  int linesPerLevel;
+  int lineScore[5];                      /* times level, by lines cleared at once */
+  int backToBackPercent;                 /* bonus on a tetris right after a tetris; 0 = none */
+  int comboBonus;                        /* times combo and level; 0 = no combos */
+  int softDropPoints;                    /* per row, times level */
+  int hardDropPoints;
+  int spawnDelayTicks;
+  int lineClearDelayTicks;
+  int lockDelayTicks;                    /* 0 = lock as soon as gravity is blocked */
+  int maxLockResets;                     /* moves/rotations that restart the lock delay */
+  int kickTests;                         /* SRS kicks tried; 1 = rotate in place only */
+  Randomizer randomizer;
+} Ruleset;
+
+/* Bottom profile of one piece orientation: for each column it covers,
+   the column offset and the lowest cell's row offset. */
+typedef struct PieceProfile {
+  int count;
+  int dx[4];
+  int bottom[4];
+} PieceProfile;
+
+/* A piece orientation shifted to one bit offset within a word: lo lands
+   in the word holding the shift, hi is what spills into the next word. */
+typedef struct PieceRowMask {
+  RowWord lo[MASK_ROWS];
+  RowWord hi[MASK_ROWS];
+} PieceRowMask;
+
+/* Kick offsets for one rotation, in board coordinates (y down). */
+#define KICK_TESTS 5
+
+/* Upcoming pieces live in a ring of QUEUE_CAPACITY entries (a power of two). */
+#define QUEUE_MASK (QUEUE_CAPACITY - 1)
+typedef struct RotationKicks {
+  int count;
+  int dx[KICK_TESTS];
+  int dy[KICK_TESTS];
+} RotationKicks;
+
+/* Everything one running game owns. The struct is plain data and its
+   per-board arrays follow it in the same allocation (see GameCreate), so a
+   game is one self-contained block of size bytes and any number of them
+   can run side by side. */
+struct GameState {
+  uint32_t size;            /* struct + trailing arrays, in bytes */
+
+  /* Board geometry, walls and floor included. */
+  int cols;
+  int rows;
+  int rowWords;             /* words holding one row's bits */
+  int rowStride;            /* rowWords + 1 all-set word that masks may spill into */
+  int slots;
+  int colorRowBytes;
+
+  /* Byte offsets of the per-board arrays inside data[]. */
+  uint32_t offRowStore;
+  uint32_t offEmptyRow;
+  uint32_t offRowHash;
+  uint32_t offColHeight;
+  uint32_t offRowSlot;
+  uint32_t offRowFill;
+  uint32_t offRowColors;
+
+  int stackHeight;
+  uint64_t boardHash;       /* kept by LockCurrentPiece/ApplyLineClearNow */
+  uint64_t pieceHash;       /* active piece pose, 0 while none is active */
+
+  ActivePiece  cur;
+  bool         pieceActive;
+  PiecesFormat queue[QUEUE_CAPACITY];
+  unsigned     queueHead;   /* next piece is queue[queueHead & QUEUE_MASK] */
+  int          queueCount;
+  int          previewCount;  /* pieces kept dealt ahead, 1..QUEUE_CAPACITY */
+
+  /* Piece generation: the seed alone fixes the whole piece sequence. */
+  uint64_t     seed;
+  uint64_t     rng[4];      /* xoshiro256** */
+  Randomizer   randomizer;
+  PiecesFormat bag[TETROMINO_COUNT];
+  int          bagLeft;     /* pieces of bag not dealt yet */
+  PiecesFormat lastType;
+  bool         itsOver;
+
+  RulesetId ruleset;
+
+  int   gravity;            /* GRAVITY_ONE units fallen per tick */
+  int   gravityAcc;         /* fraction of a row fallen so far */
+  int   lockTicks;          /* ticks the piece has rested on the stack */
+  int   lockResets;
+  int   spawnDelayTicks;
+
+  unsigned input;           /* InputBits held on the latest tick */
+  int   holdLeftTicks;      /* ticks each button has been held, 0 = up */
+  int   holdRightTicks;
+  int   holdDownTicks;
+  bool  downBlocked;
+  int   dasTicks;           /* handling, see GameSetHandling */
+  int   arrTicks;
+  int   sdArrTicks;
+
+  bool clearingLines;
+  int  clearTimerTicks;
+  int  blinkTickCounter;
+  bool blinkOn;
+  int  linesToClear[4];
+  int  linesToClearCount;
+
+  int  score;
+  int  linesCleared;
+  int  level;
+  int  combo;
+  bool backToBack;
+
+  unsigned events;           /* GameEvent bits raised by the latest step */
+
+  RowWord data[];
+};
+
+/* ===================== SHAPES ===================== */
+
+/* SRS orientations 0, R, 2, L (y grows downward). J, L, S, T and Z turn
+   around (0,1) and I around (0.5,0.5), so every state fits the piece mask
+   rows -1..2 and spawn state 0 sits in rows 0..1. */
+static const int SHAPES[TETROMINO_COUNT][4][4][2] = {
+  /* I */
+  {
+    {{-1,0},{0,0},{1,0},{2,0}},
+    {{1,-1},{1,0},{1,1},{1,2}},
+    {{-1,1},{0,1},{1,1},{2,1}},
+    {{0,-1},{0,0},{0,1},{0,2}},
+  },
+  /* O */
+  {
+    {{0,0},{1,0},{0,1},{1,1}},
+    {{0,0},{1,0},{0,1},{1,1}},
+    {{0,0},{1,0},{0,1},{1,1}},
+    {{0,0},{1,0},{0,1},{1,1}},
+  },
+  /* T */
+  {
+    {{0,0},{-1,1},{0,1},{1,1}},
+    {{0,0},{0,1},{1,1},{0,2}},
+    {{-1,1},{0,1},{1,1},{0,2}},
+    {{0,0},{-1,1},{0,1},{0,2}},
+  },
+  /* S */
+  {
+    {{0,0},{1,0},{-1,1},{0,1}},
+    {{0,0},{0,1},{1,1},{1,2}},
+    {{0,1},{1,1},{-1,2},{0,2}},
+    {{-1,0},{-1,1},{0,1},{0,2}},
+  },
+  /* Z */
+  {
+    {{-1,0},{0,0},{0,1},{1,1}},
+    {{1,0},{0,1},{1,1},{0,2}},
+    {{-1,1},{0,1},{0,2},{1,2}},
+    {{0,0},{-1,1},{0,1},{-1,2}},
+  },
+  /* J */
+  {
+    {{-1,0},{-1,1},{0,1},{1,1}},
+    {{0,0},{1,0},{0,1},{0,2}},
+    {{-1,1},{0,1},{1,1},{1,2}},
+    {{0,0},{0,1},{-1,2},{0,2}},
+  },
+  /* L */
+  {
+    {{1,0},{-1,1},{0,1},{1,1}},
+    {{0,0},{0,1},{0,2},{1,2}},
+    {{-1,1},{0,1},{1,1},{-1,2}},
+    {{-1,0},{0,0},{0,1},{0,2}},
+  },
+};
+
+/* SRS wall kicks as published (x right, y up), tried in order when turning
+   from state [rot] clockwise [0] or counter-clockwise [1]. O never kicks. */
+static const int KICKS_JLSTZ[4][2][KICK_TESTS][2] = {
+  { {{0,0},{-1,0},{-1, 1},{0,-2},{-1,-2}}, {{0,0},{ 1,0},{ 1, 1},{0,-2},{ 1,-2}} },
+  { {{0,0},{ 1,0},{ 1,-1},{0, 2},{ 1, 2}}, {{0,0},{ 1,0},{ 1,-1},{0, 2},{ 1, 2}} },
+  { {{0,0},{ 1,0},{ 1, 1},{0,-2},{ 1,-2}}, {{0,0},{-1,0},{-1, 1},{0,-2},{-1,-2}} },
+  { {{0,0},{-1,0},{-1,-1},{0, 2},{-1, 2}}, {{0,0},{-1,0},{-1,-1},{0, 2},{-1, 2}} },
+};
+static const int KICKS_I[4][2][KICK_TESTS][2] = {
+  { {{0,0},{-2,0},{ 1,0},{-2,-1},{ 1, 2}}, {{0,0},{-1,0},{ 2,0},{-1, 2},{ 2,-1}} },
+  { {{0,0},{-1,0},{ 2,0},{-1, 2},{ 2,-1}}, {{0,0},{ 2,0},{-1,0},{ 2, 1},{-1,-2}} },
+  { {{0,0},{ 2,0},{-1,0},{ 2, 1},{-1,-2}}, {{0,0},{ 1,0},{-2,0},{ 1,-2},{-2, 1}} },
+  { {{0,0},{ 1,0},{-2,0},{ 1,-2},{-2, 1}}, {{0,0},{-2,0},{ 1,0},{-2,-1},{ 1, 2}} },
+};
+
+/* ===================== RULESETS ===================== */
+
+/* This game's own rules: the original speed curve, then 1G at level 29
+   rising by one row per tick each level up to 20G. */
+static const Ruleset rulesetRayblocks = {
+  .name = "RayBlocks",
+  .levelCount = 48,
+  .levelGravity = {
+    ROWS_PER_SECOND(1),  ROWS_PER_SECOND(2),  ROWS_PER_SECOND(3),  ROWS_PER_SECOND(4),
+    ROWS_PER_SECOND(5),  ROWS_PER_SECOND(6),  ROWS_PER_SECOND(7),  ROWS_PER_SECOND(8),
+    ROWS_PER_SECOND(9),  ROWS_PER_SECOND(12), ROWS_PER_SECOND(12), ROWS_PER_SECOND(12),
+    ROWS_PER_SECOND(15), ROWS_PER_SECOND(15), ROWS_PER_SECOND(15), ROWS_PER_SECOND(20),
+    ROWS_PER_SECOND(20), ROWS_PER_SECOND(20), ROWS_PER_SECOND(30), ROWS_PER_SECOND(30),
+    ROWS_PER_SECOND(30), ROWS_PER_SECOND(30), ROWS_PER_SECOND(30), ROWS_PER_SECOND(30),
+    ROWS_PER_SECOND(30), ROWS_PER_SECOND(30), ROWS_PER_SECOND(30), ROWS_PER_SECOND(30),
+     1*GRAVITY_ONE,  2*GRAVITY_ONE,  3*GRAVITY_ONE,  4*GRAVITY_ONE,  5*GRAVITY_ONE,
+     6*GRAVITY_ONE,  7*GRAVITY_ONE,  8*GRAVITY_ONE,  9*GRAVITY_ONE, 10*GRAVITY_ONE,
+    11*GRAVITY_ONE, 12*GRAVITY_ONE, 13*GRAVITY_ONE, 14*GRAVITY_ONE, 15*GRAVITY_ONE,
+    16*GRAVITY_ONE, 17*GRAVITY_ONE, 18*GRAVITY_ONE, 19*GRAVITY_ONE, 20*GRAVITY_ONE,
+  },
+  .linesPerLevel       = 10,
+  .lineScore           = { 0, 100, 300, 500, 800 },
+  .backToBackPercent   = 50,
+  .comboBonus          = 50,
+  .softDropPoints      = 1,
+  .hardDropPoints      = 2,
+  .spawnDelayTicks     = 15,
+  .lineClearDelayTicks = 20,
+  .lockDelayTicks      = 0,
+  .maxLockResets       = 0,
+  .kickTests           = KICK_TESTS,
+  .randomizer          = RANDOMIZER_BAG7,
+};
+
+/* Guideline: (0.8 - (level-1)*0.007)^(level-1) seconds per row, reaching
+   20G at level 19; half-second lock delay with 15 move resets. */
+static const Ruleset rulesetGuideline = {
+  .name = "Guideline",
+  .levelCount = 19,
+  .levelGravity = {
+    1092, 1377, 1768, 2311, 3075, 4169, 5759, 8107, 11634, 17026,
+    25416, 38709, 60169, 95483, 154742, 256187, 433425, 749597, 20*GRAVITY_ONE,
+  },
+  .linesPerLevel       = 10,
+  .lineScore           = { 0, 100, 300, 500, 800 },
+  .backToBackPercent   = 50,
+  .comboBonus          = 50,
+  .softDropPoints      = 1,
+  .hardDropPoints      = 2,
+  .spawnDelayTicks     = 6,
+  .lineClearDelayTicks = 20,
+  .lockDelayTicks      = 30,
+  .maxLockResets       = 15,
+  .kickTests           = KICK_TESTS,
+  .randomizer          = RANDOMIZER_BAG7,
+};
+
+/* NES: frames per row from its level table (level 1 here is NES level 0),
+   NES line scores, no combos, kicks or lock delay. */
+static const Ruleset rulesetNes = {
+  .name = "NES",
+  .levelCount = 30,
+  .levelGravity = {
+    TICKS_PER_ROW(48), TICKS_PER_ROW(43), TICKS_PER_ROW(38), TICKS_PER_ROW(33), TICKS_PER_ROW(28),
+    TICKS_PER_ROW(23), TICKS_PER_ROW(18), TICKS_PER_ROW(13), TICKS_PER_ROW(8),  TICKS_PER_ROW(6),
+    TICKS_PER_ROW(5),  TICKS_PER_ROW(5),  TICKS_PER_ROW(5),  TICKS_PER_ROW(4),  TICKS_PER_ROW(4),
+    TICKS_PER_ROW(4),  TICKS_PER_ROW(3),  TICKS_PER_ROW(3),  TICKS_PER_ROW(3),  TICKS_PER_ROW(2),
+    TICKS_PER_ROW(2),  TICKS_PER_ROW(2),  TICKS_PER_ROW(2),  TICKS_PER_ROW(2),  TICKS_PER_ROW(2),
+    TICKS_PER_ROW(2),  TICKS_PER_ROW(2),  TICKS_PER_ROW(2),  TICKS_PER_ROW(2),  TICKS_PER_ROW(1),
+  },
+  .linesPerLevel       = 10,
+  .lineScore           = { 0, 40, 100, 300, 1200 },
+  .backToBackPercent   = 0,
+  .comboBonus          = 0,
+  .softDropPoints      = 1,
+  .hardDropPoints      = 0,
+  .spawnDelayTicks     = 10,
+  .lineClearDelayTicks = 20,
+  .lockDelayTicks      = 0,
+  .maxLockResets       = 0,
+  .kickTests           = 1,
+  .randomizer          = RANDOMIZER_REROLL,
+};
+
+static const Ruleset *const RULESETS[RULESET_COUNT] = {
+#define RULESET_ENTRY(id, table) [RULESET_##id] = &table,
+  RULESET_LIST(RULESET_ENTRY)
+#undef RULESET_ENTRY
+};
+
+/* Row masks per (piece, rotation, bit shift): placing at x uses entry
+   (x + MASK_X_BIAS) & 63 against row words (x + MASK_X_BIAS) >> 6 and the
+   one after it, so the table does not depend on the board width. Cells
+   left of the field land on the always-set margin bits and collide. */
+static PieceRowMask pieceMasks[TETROMINO_COUNT][4][64];
+static PieceProfile pieceProfiles[TETROMINO_COUNT][4];
+static RotationKicks rotationKicks[TETROMINO_COUNT][4][2];
+
+static void InitPieceMasks(void) {
+  for (int t = 0; t < TETROMINO_COUNT; t++)
+    for (int rot = 0; rot < 4; rot++) {
+      RowWord pattern[MASK_ROWS] = {0};
+      for (int i = 0; i < 4; i++)
+        pattern[SHAPES[t][rot][i][1] + 1] |= (RowWord)1 << (SHAPES[t][rot][i][0] + MASK_X_BIAS);
+      for (int shift = 0; shift < 64; shift++) {
+        PieceRowMask *m = &pieceMasks[t][rot][shift];
+        for (int i = 0; i < MASK_ROWS; i++) {
+          m->lo[i] = pattern[i] << shift;
+          m->hi[i] = shift ? pattern[i] >> (64 - shift) : 0;
+        }
+      }
+    }
+
+  for (int t = 0; t < TETROMINO_COUNT; t++)
+    for (int rot = 0; rot < 4; rot++) {
+      PieceProfile *p = &pieceProfiles[t][rot];
+      p->count = 0;
+      for (int i = 0; i < 4; i++) {
+        int dx = SHAPES[t][rot][i][0], dy = SHAPES[t][rot][i][1];
+        int c = 0;
+        while (c < p->count && p->dx[c] != dx) c++;
+        if (c == p->count) { p->dx[c] = dx; p->bottom[c] = dy; p->count++; }
+        else if (dy > p->bottom[c]) p->bottom[c] = dy;
+      }
+    }
+
+  for (int t = 0; t < TETROMINO_COUNT; t++)
+    for (int rot = 0; rot < 4; rot++)
+      for (int dir = 0; dir < 2; dir++) {
+        RotationKicks *k = &rotationKicks[t][rot][dir];
+        const int (*table)[2] = (t == I) ? KICKS_I[rot][dir] : KICKS_JLSTZ[rot][dir];
+        k->count = (t == O) ? 1 : KICK_TESTS;
+        for (int i = 0; i < k->count; i++) {
+          k->dx[i] =  table[i][0];
+          k->dy[i] = -table[i][1];
+        }
+      }
+}
+
+/* Zobrist keys. The board hash XORs one key per occupied column into a
+   per-row hash, then folds each non-empty row in with its y, so a line
+   clear re-folds only the rows that moved instead of rehashing cells.
+   Keys come from a fixed seed: equal positions hash equally across runs. */
+static uint64_t zobristCol[MAX_BOARD_COLS];
+static uint64_t zobristRowY[MAX_BOARD_ROWS];
+static uint64_t zobristPiece[TETROMINO_COUNT][4];
+static uint64_t zobristPieceX[MAX_BOARD_COLS + 2*MASK_X_BIAS];
+static uint64_t zobristPieceY[BOARD_PAD_TOP + MAX_BOARD_ROWS + BOARD_PAD_BOTTOM];
+static uint64_t zobristQueue[QUEUE_CAPACITY][TETROMINO_COUNT];
+
+static uint64_t SplitMix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static void InitZobristKeys(void) {
+  uint64_t seed = 0x5241594B45595321ull;
+  for (int i = 0; i < MAX_BOARD_COLS; i++) zobristCol[i]  = SplitMix64(&seed);
+  for (int i = 0; i < MAX_BOARD_ROWS; i++) zobristRowY[i] = SplitMix64(&seed);
+  for (int t = 0; t < TETROMINO_COUNT; t++)
+    for (int rot = 0; rot < 4; rot++) zobristPiece[t][rot] = SplitMix64(&seed);
+  for (int i = 0; i < MAX_BOARD_COLS + 2*MASK_X_BIAS; i++) zobristPieceX[i] = SplitMix64(&seed);
+  for (int i = 0; i < BOARD_PAD_TOP + MAX_BOARD_ROWS + BOARD_PAD_BOTTOM; i++) zobristPieceY[i] = SplitMix64(&seed);
+  for (int i = 0; i < QUEUE_CAPACITY; i++)
+    for (int t = 0; t < TETROMINO_COUNT; t++) zobristQueue[i][t] = SplitMix64(&seed);
+}
+
+void EngineInit(void) {
+  InitPieceMasks();
+  InitZobristKeys();
+}
+
+/* ===================== GAME STATE ===================== */
+
+/* Rows live in physical slots; the row slot table names the slot holding
+   logical row y (padding rows included). A line clear only shifts slot
+   numbers and blanks the freed slots, so per-row data is indexed by slot.
+   The colour plane, read only by the renderer, packs 4 bits per cell:
+   0 = none, else PiecesFormat+1. colHeight is the filled height of each
+   column above the floor, kept in step by LockCurrentPiece/ApplyLineClearNow. */
+
+static inline RowWord *GameRowStore(const GameState *g) {
+  return (RowWord *)((unsigned char *)g->data + g->offRowStore);
+}
+static inline RowWord *GameEmptyRow(const GameState *g) {
+  return (RowWord *)((unsigned char *)g->data + g->offEmptyRow);
+}
+static inline int *GameColHeight(const GameState *g) {
+  return (int *)((unsigned char *)g->data + g->offColHeight);
+}
+/* Indexed by logical row y, padding rows included (y may be negative). */
+static inline uint16_t *GameRowSlot(const GameState *g) {
+  return (uint16_t *)((unsigned char *)g->data + g->offRowSlot) + BOARD_PAD_TOP;
+}
+static inline uint16_t *GameRowFill(const GameState *g) {
+  return (uint16_t *)((unsigned char *)g->data + g->offRowFill);
+}
+static inline uint8_t *GameRowColors(const GameState *g) {
+  return (uint8_t *)g->data + g->offRowColors;
+}
+/* Indexed by slot: XOR of zobristCol over the row's placed cells. */
+static inline uint64_t *GameRowHash(const GameState *g) {
+  return (uint64_t *)((unsigned char *)g->data + g->offRowHash);
+}
+
+/* One allocation per game: the struct followed by every per-board array. */
+GameState *GameCreate(int cols, int rows) {
+  if (cols < 6) cols = 6;
+  if (cols > MAX_BOARD_COLS) cols = MAX_BOARD_COLS;
+  if (rows < 6) rows = 6;
+  if (rows > MAX_BOARD_ROWS) rows = MAX_BOARD_ROWS;
+
+  int words  = (cols + 2*BOARD_MARGIN + 63) / 64;
+  int stride = words + 1;
+  int slots  = BOARD_PAD_TOP + rows + BOARD_PAD_BOTTOM;
+  int cbytes = (cols + 1) / 2;
+
+  size_t off = 0;
+  size_t offRowStore  = off; off += (size_t)slots * stride * sizeof(RowWord);
+  size_t offEmptyRow  = off; off += (size_t)stride * sizeof(RowWord);
+  size_t offRowHash   = off; off += (size_t)slots * sizeof(uint64_t);
+  size_t offColHeight = off; off += (size_t)cols * sizeof(int);
+  size_t offRowSlot   = off; off += (size_t)slots * sizeof(uint16_t);
+  size_t offRowFill   = off; off += (size_t)slots * sizeof(uint16_t);
+  size_t offRowColors = off; off += (size_t)slots * cbytes;
+
+  size_t size = sizeof(GameState) + off;
+  GameState *g = malloc(size);
+  if (!g) return NULL;
+  memset(g, 0, size);
+  g->size          = (uint32_t)size;
+  g->cols          = cols;
+  g->rows          = rows;
+  g->rowWords      = words;
+  g->rowStride     = stride;
+  g->slots         = slots;
+  g->colorRowBytes = cbytes;
+  g->offRowStore   = (uint32_t)offRowStore;
+  g->offEmptyRow   = (uint32_t)offEmptyRow;
+  g->offRowHash    = (uint32_t)offRowHash;
+  g->offColHeight  = (uint32_t)offColHeight;
+  g->offRowSlot    = (uint32_t)offRowSlot;
+  g->offRowFill    = (uint32_t)offRowFill;
+  g->offRowColors  = (uint32_t)offRowColors;
+  g->previewCount  = DEFAULT_PREVIEWS;
+  g->dasTicks      = DEFAULT_DAS_TICKS;
+  g->arrTicks      = DEFAULT_ARR_TICKS;
+  g->sdArrTicks    = DEFAULT_SD_ARR_TICKS;
+  return g;
+}
+
+void GameDestroy(GameState *g) {
+  free(g);
+}
+
+/* A snapshot is the game block itself: g->size bytes, no pointers inside,
+   so taking and restoring one is a single memcpy. */
+size_t GameSnapshotSize(const GameState *g) {
+  return g->size;
+}
+
+void GameSnapshot(const GameState *g, void *out) {
+  memcpy(out, g, g->size);
+}
+
+/* Fails, leaving g untouched, if the snapshot was taken on another board size. */
+bool GameRestore(GameState *g, const void *snapshot) {
+  const GameState *s = (const GameState *)snapshot;
+  if (s->size != g->size || s->cols != g->cols || s->rows != g->rows) return false;
+  memcpy(g, snapshot, g->size);
+  return true;
+}
+
+/* ===================== RANDOMIZER ===================== */
+
+static inline uint64_t Rotl64(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t NextRandom(GameState *g) {
+  uint64_t *s = g->rng;
+  uint64_t result = Rotl64(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = Rotl64(s[3], 45);
+  return result;
+}
+
+/* Uniform in [0, n) by multiply-shift; the bias is below 2^-32. */
+static inline int RandomBelow(GameState *g, int n) {
+  return (int)(((NextRandom(g) >> 32) * (uint64_t)n) >> 32);
+}
+
+static void SeedRandom(GameState *g, uint64_t seed) {
+  g->seed = seed;
+  for (int i = 0; i < 4; i++) g->rng[i] = SplitMix64(&seed);
+  g->bagLeft  = 0;
+  g->lastType = TETROMINO_COUNT;
+}
+
+static PiecesFormat RandomBag7(GameState *g) {
+  if (g->bagLeft == 0) {
+    for (int i = 0; i < TETROMINO_COUNT; i++) g->bag[i] = (PiecesFormat)i;
+    for (int i = TETROMINO_COUNT-1; i > 0; i--) {
+      int j = RandomBelow(g, i + 1);
+      PiecesFormat t = g->bag[i]; g->bag[i] = g->bag[j]; g->bag[j] = t;
+    }
+    g->bagLeft = TETROMINO_COUNT;
+  }
+  return g->bag[--g->bagLeft];
+}
+
+static PiecesFormat RandomReroll(GameState *g) {
+  PiecesFormat t = (PiecesFormat)RandomBelow(g, TETROMINO_COUNT);
+  if (t == g->lastType) t = (PiecesFormat)RandomBelow(g, TETROMINO_COUNT);
+  g->lastType = t;
+  return t;
+}
+
+static PiecesFormat RandomPure(GameState *g) {
+  return (PiecesFormat)RandomBelow(g, TETROMINO_COUNT);
+}
+
+static PiecesFormat (*const RANDOMIZERS[RANDOMIZER_COUNT])(GameState *) = {
+  [RANDOMIZER_BAG7]   = RandomBag7,
+  [RANDOMIZER_REROLL] = RandomReroll,
+  [RANDOMIZER_PURE]   = RandomPure,
+};
+
+static PiecesFormat RandomType(GameState *g) {
+  return RANDOMIZERS[g->randomizer](g);
+}
+
+/* ===================== PIECE QUEUE ===================== */
+
+/* Read in place from the ring. */
+PiecesFormat QueuePeek(const GameState *g, int i) {
+  return g->queue[(g->queueHead + (unsigned)i) & QUEUE_MASK];
+}
+
+/* Deals pieces only until previewCount are waiting. */
+static void QueueFill(GameState *g) {
+  while (g->queueCount < g->previewCount) {
+    g->queue[(g->queueHead + (unsigned)g->queueCount) & QUEUE_MASK] = RandomType(g);
+    g->queueCount++;
+  }
+}
+
+static PiecesFormat QueuePop(GameState *g) {
+  QueueFill(g);
+  PiecesFormat t = g->queue[g->queueHead & QUEUE_MASK];
+  g->queueHead++;
+  g->queueCount--;
+  QueueFill(g);
+  return t;
+}
+
+/* ===================== ENGINE HELPERS ===================== */
+
+static inline RowWord *BoardRow(const GameState *g, int y) {
+  return GameRowStore(g) + (size_t)GameRowSlot(g)[y] * g->rowStride;
+}
+
+static inline bool RowTest(const RowWord *row, int x) {
+  int b = x + BOARD_MARGIN;
+  return (row[b >> 6] >> (b & 63)) & 1;
+}
+
+static inline void RowSet(RowWord *row, int x) {
+  int b = x + BOARD_MARGIN;
+  row[b >> 6] |= (RowWord)1 << (b & 63);
+}
+
+/* A row's share of boardHash at height y; empty rows contribute nothing. */
+static inline uint64_t RowHashAt(uint64_t rowHash, int y) {
+  if (!rowHash) return 0;
+  uint64_t z = rowHash ^ zobristRowY[y];
+  z = (z ^ (z >> 31)) * 0x7FB5D329728EA185ull;
+  return z ^ (z >> 27);
+}
+
+static inline uint64_t PieceHash(const ActivePiece *p) {
+  return zobristPiece[p->type][p->rot]
+       ^ zobristPieceX[p->x + MASK_X_BIAS]
+       ^ zobristPieceY[p->y + BOARD_PAD_TOP];
+}
+
+uint64_t GameHash(const GameState *g) {
+  uint64_t h = g->boardHash ^ g->pieceHash;
+  for (int i = 0; i < g->previewCount; i++)
+    h ^= zobristQueue[i][g->queue[(g->queueHead + i) & QUEUE_MASK]];
+  return h;
+}
+
+/* Four ANDs against the padded board. Only x/y far outside the field are
+   rejected up front (every cell of such a placement would be off the board). */
+static bool CanPlace(const GameState *g, PiecesFormat t, int rot, int px, int py) {
+  unsigned bx = (unsigned)(px + MASK_X_BIAS);
+  if (bx >= (unsigned)(g->cols + 2*MASK_X_BIAS)) return false;
+  if ((unsigned)(py - 1 + BOARD_PAD_TOP) > (unsigned)(g->slots - MASK_ROWS)) return false;
+  const PieceRowMask *m = &pieceMasks[t][rot][bx & 63];
+  const RowWord  *base  = GameRowStore(g) + (bx >> 6);
+  const uint16_t *s     = GameRowSlot(g) + py - 1;
+  RowWord hit = 0;
+  for (int i = 0; i < MASK_ROWS; i++) {
+    const RowWord *r = base + (size_t)s[i] * g->rowStride;
+    hit |= (r[0] & m->lo[i]) | (r[1] & m->hi[i]);
+  }
+  return hit == 0;
+}
+
+/* Only rows the last piece touched can have become full. */
+static int FindFullLines(const GameState *g, int top, int bottom, int outLines[4]) {
+  const uint16_t *rowSlot = GameRowSlot(g);
+  const uint16_t *rowFill = GameRowFill(g);
+  int count = 0;
+  if (top < 0) top = 0;
+  if (bottom > g->rows-2) bottom = g->rows-2;
+  for (int y = top; y <= bottom; y++)
+    if (rowFill[rowSlot[y]] == g->cols-2 && count < 4) outLines[count++] = y;
+  return count;
+}
+
+/* clearLines must be ascending, as FindFullLines returns them. Each run of
+   rows between two cleared lines slides down by the number of cleared lines
+   below it (bottom run first), then the freed slots become the top rows. */
+static void ApplyLineClearNow(GameState *g, const int clearLines[4], int clearCount) {
+  if (clearCount <= 0) return;
+  uint16_t *rowSlot = GameRowSlot(g);
+  uint16_t *rowFill = GameRowFill(g);
+  uint64_t *rowHash = GameRowHash(g);
+  int *colHeight    = GameColHeight(g);
+
+  /* Only rows from the stack top down to the lowest cleared line move. */
+  int top  = g->rows-1 - g->stackHeight;
+  int last = clearLines[clearCount-1];
+  if (top < 0) top = 0;
+  for (int y = top; y <= last; y++) g->boardHash ^= RowHashAt(rowHash[rowSlot[y]], y);
+
+  uint16_t freed[4];
+  for (int i = 0; i < clearCount; i++) freed[i] = rowSlot[clearLines[i]];
+  for (int i = clearCount-1; i >= 0; i--) {
+    int first = (i > 0) ? clearLines[i-1] + 1 : 0;
+    int n     = clearLines[i] - first;
+    if (n > 0) memmove(&rowSlot[first + clearCount - i], &rowSlot[first], (size_t)n * sizeof(uint16_t));
+  }
+  for (int i = 0; i < clearCount; i++) {
+    rowSlot[i]          = freed[i];
+    rowFill[freed[i]]   = 0;
+    rowHash[freed[i]]   = 0;
+    memcpy(GameRowStore(g) + (size_t)freed[i] * g->rowStride, GameEmptyRow(g), (size_t)g->rowStride * sizeof(RowWord));
+    memset(GameRowColors(g) + (size_t)freed[i] * g->colorRowBytes, 0, (size_t)g->colorRowBytes);
+  }
+  for (int y = top + clearCount; y <= last; y++) g->boardHash ^= RowHashAt(rowHash[rowSlot[y]], y);
+
+  /* Every column crossed each cleared row, so it sinks by at least clearCount;
+     it sinks further only when the cells right under its old top were holes. */
+  g->stackHeight = 0;
+  for (int x = 1; x < g->cols-1; x++) {
+    int h = colHeight[x] - clearCount;
+    if (h < 0) h = 0;
+    while (h > 0 && !RowTest(BoardRow(g, g->rows-1-h), x)) h--;
+    colHeight[x] = h;
+    if (h > g->stackHeight) g->stackHeight = h;
+  }
+}
+
+/* Rows the piece can fall from (px,py) before it rests. While every piece
+   column is above that column's stack top the answer comes straight from
+   colHeight; a piece tucked under an overhang falls back to stepping. */
+static int DropDistance(const GameState *g, PiecesFormat t, int rot, int px, int py) {
+  const PieceProfile *p = &pieceProfiles[t][rot];
+  const int *colHeight  = GameColHeight(g);
+  int dist = g->rows;
+  for (int i = 0; i < p->count; i++) {
+    int gx     = px + p->dx[i];
+    int bottom = py + p->bottom[i];
+    int top    = g->rows-1 - colHeight[gx];
+    if (bottom >= top) {
+      dist = 0;
+      while (CanPlace(g, t, rot, px, py + dist + 1)) dist++;
+      return dist;
+    }
+    if (top - bottom - 1 < dist) dist = top - bottom - 1;
+  }
+  return dist;
+}
+
+/* ===================== SCORING ===================== */
+
+/* Engine functions that read a Ruleset are forced inline so that, inside
+   each ruleset's step function, every rule is a constant. */
+#define RULES_INLINE static inline __attribute__((always_inline))
+
+RULES_INLINE int RulesetGravity(const Ruleset *r, int level) {
+  if (level < 1) level = 1;
+  return r->levelGravity[(level < r->levelCount ? level : r->levelCount) - 1];
+}
+
+RULES_INLINE void ApplyScoring(GameState *g, const Ruleset *r, int clearedThisMove) {
+  if (clearedThisMove > 0) {
+    g->linesCleared += clearedThisMove;
+    g->level = 1 + (g->linesCleared / r->linesPerLevel);
+  }
+  int add = r->lineScore[clearedThisMove] * g->level;
+  if (clearedThisMove == 4) {
+    if (g->backToBack) add += add * r->backToBackPercent / 100;
+    g->backToBack = true;
+  } else if (clearedThisMove > 0) {
+    g->backToBack = false;
+  }
+  if (clearedThisMove > 0) {
+    g->combo++;
+    if (g->combo > 0) add += (r->comboBonus * g->combo * g->level);
+  } else {
+    g->combo = -1;
+  }
+  g->score += add;
+  g->gravity    = RulesetGravity(r, g->level);
+  g->gravityAcc = 0;
+}
+
+/* ===================== PIECE ACTIONS ===================== */
+
+RULES_INLINE void LockCurrentPiece(GameState *g, const Ruleset *r) {
+  const ActivePiece *cur = &g->cur;
+  uint16_t *rowSlot = GameRowSlot(g);
+  uint16_t *rowFill = GameRowFill(g);
+  uint64_t *rowHash = GameRowHash(g);
+  int *colHeight    = GameColHeight(g);
+  int top = g->rows, bottom = -1;
+  for (int i = 0; i < 4; i++) {
+    int gx = cur->x + SHAPES[cur->type][cur->rot][i][0];
+    int gy = cur->y + SHAPES[cur->type][cur->rot][i][1];
+    if (gy < 0) continue;
+    int slot = rowSlot[gy];
+    RowSet(GameRowStore(g) + (size_t)slot * g->rowStride, gx);
+    rowFill[slot]++;
+    g->boardHash ^= RowHashAt(rowHash[slot], gy);
+    rowHash[slot] ^= zobristCol[gx];
+    g->boardHash ^= RowHashAt(rowHash[slot], gy);
+    GameRowColors(g)[(size_t)slot * g->colorRowBytes + (gx >> 1)] |= (uint8_t)((cur->type + 1) << ((gx & 1) * 4));
+    if (gy < top)    top    = gy;
+    if (gy > bottom) bottom = gy;
+    int h = g->rows-1 - gy;
+    if (h > colHeight[gx])  colHeight[gx]  = h;
+    if (h > g->stackHeight) g->stackHeight = h;
+  }
+  g->pieceActive = false;
+  g->pieceHash   = 0;
+  g->events     |= EVENT_LOCK;
+
+  if (g->input & INPUT_SOFT_DROP) {
+    g->downBlocked   = true;
+    g->holdDownTicks = 0;
+  }
+
+  g->linesToClearCount = FindFullLines(g, top, bottom, g->linesToClear);
+  if (g->linesToClearCount > 0) {
+    g->clearingLines     = true;
+    g->clearTimerTicks  = r->lineClearDelayTicks;
+    g->blinkTickCounter = 0;
+    g->blinkOn = false;
+    g->events |= EVENT_LINE_CLEAR;
+    if (g->linesToClearCount == 4) g->events |= EVENT_TETRIS;
+  } else {
+    ApplyScoring(g, r, 0);
+    g->spawnDelayTicks = r->spawnDelayTicks;
+  }
+}
+
+static void GenerateRandomPiece(GameState *g) {
+  g->cur.type = QueuePop(g);
+  g->cur.rot  = 0;
+  g->cur.x    = (g->cols-2) / 2;
+  g->cur.y    = 0;
+  if (!CanPlace(g, g->cur.type, g->cur.rot, g->cur.x, g->cur.y)) {
+    g->itsOver     = true;
+    g->pieceActive = false;
+    g->events     |= EVENT_GAME_OVER;
+    return;
+  }
+  g->pieceActive = true;
+  g->pieceHash   = PieceHash(&g->cur);
+  g->lockTicks   = 0;
+  g->lockResets  = 0;
+}
+
+static bool TryMove(GameState *g, int dx, int dy) {
+  int nx = g->cur.x + dx;
+  int ny = g->cur.y + dy;
+  if (!CanPlace(g, g->cur.type, g->cur.rot, nx, ny)) return false;
+  g->pieceHash ^= zobristPieceX[g->cur.x + MASK_X_BIAS] ^ zobristPieceX[nx + MASK_X_BIAS]
+                ^ zobristPieceY[g->cur.y + BOARD_PAD_TOP] ^ zobristPieceY[ny + BOARD_PAD_TOP];
+  g->cur.x = nx;
+  g->cur.y = ny;
+  return true;
+}
+
+/* dir is ROT_CW or ROT_CCW; the first kick that fits wins, as in SRS. */
+RULES_INLINE void TryRotate(GameState *g, const Ruleset *r, int dir) {
+  ActivePiece *cur = &g->cur;
+  int nr = (cur->rot + dir) & 3;
+  const RotationKicks *k = &rotationKicks[cur->type][cur->rot][dir < 0];
+  int tests = k->count < r->kickTests ? k->count : r->kickTests;
+  for (int i = 0; i < tests; i++) {
+    int nx = cur->x + k->dx[i];
+    int ny = cur->y + k->dy[i];
+    if (CanPlace(g, cur->type, nr, nx, ny)) {
+      cur->x = nx; cur->y = ny; cur->rot = nr;
+      g->pieceHash = PieceHash(cur);
+      return;
+    }
+  }
+}
+
+/* Whole rows owed by the accumulated gravity fall in one landing query, so
+   20G costs the same as 1G. Without a lock delay, falling further than the
+   piece can go locks it, as a blocked gravity step always has. */
+RULES_INLINE void ApplyGravity(GameState *g, const Ruleset *r) {
+  g->gravityAcc += g->gravity;
+  int rows = g->gravityAcc / GRAVITY_ONE;
+  if (rows == 0) return;
+  g->gravityAcc %= GRAVITY_ONE;
+  ActivePiece *cur = &g->cur;
+  int room = DropDistance(g, cur->type, cur->rot, cur->x, cur->y);
+  int fall = rows < room ? rows : room;
+  if (fall > 0) {
+    g->pieceHash ^= zobristPieceY[cur->y + BOARD_PAD_TOP] ^ zobristPieceY[cur->y + fall + BOARD_PAD_TOP];
+    cur->y += fall;
+  }
+  if (rows > room && r->lockDelayTicks == 0) LockCurrentPiece(g, r);
+}
+
+/* A grounded piece locks after lockDelayTicks ticks on the stack; moving or
+   rotating it restarts the count, at most maxLockResets times. */
+RULES_INLINE void UpdateLockDelay(GameState *g, const Ruleset *r, bool moved) {
+  if (DropDistance(g, g->cur.type, g->cur.rot, g->cur.x, g->cur.y) > 0) { g->lockTicks = 0; return; }
+  if (moved && g->lockResets < r->maxLockResets) { g->lockTicks = 0; g->lockResets++; }
+  if (++g->lockTicks >= r->lockDelayTicks) LockCurrentPiece(g, r);
+}
+
+RULES_INLINE void HardDrop(GameState *g, const Ruleset *r) {
+  int dropped = DropDistance(g, g->cur.type, g->cur.rot, g->cur.x, g->cur.y);
+  g->cur.y += dropped;
+  g->score += dropped * r->hardDropPoints * g->level;
+  LockCurrentPiece(g, r);
+}
+
+/* ===================== INPUT (HORIZONTAL) ===================== */
+
+/* Steps due on this tick for a button held for t ticks before it (0 on the
+   press tick): one on the press, then one at das and every arr ticks after.
+   -1 means as many as the board allows (arr 0). */
+static int RepeatSteps(int t, int das, int arr) {
+  if (t == 0) return 1;
+  if (t < das) return 0;
+  if (arr == 0) return -1;
+  return (t - das) % arr == 0;
+}
+
+static void AutoShift(GameState *g, int *held, int dx) {
+  int steps = RepeatSteps((*held)++, g->dasTicks, g->arrTicks);
+  for (int i = 0; steps < 0 || i < steps; i++)
+    if (!TryMove(g, dx, 0)) break;
+}
+
+static void HandleHorizontalInput(GameState *g) {
+  bool left  = g->input & INPUT_LEFT;
+  bool right = g->input & INPUT_RIGHT;
+  if (left && right) { g->holdLeftTicks = g->holdRightTicks = 0; return; }
+  if (left) AutoShift(g, &g->holdLeftTicks, LEFT);
+  else      g->holdLeftTicks = 0;
+  if (right) AutoShift(g, &g->holdRightTicks, RIGHT);
+  else       g->holdRightTicks = 0;
+}
+
+/* Soft drop steps for this tick. Without a lock delay, pushing down on the
+   stack locks the piece. */
+RULES_INLINE void HandleSoftDrop(GameState *g, const Ruleset *r) {
+  if (!(g->input & INPUT_SOFT_DROP)) { g->downBlocked = false; g->holdDownTicks = 0; return; }
+  if (g->downBlocked) return;
+  int steps = RepeatSteps(g->holdDownTicks++, SD_DAS_TICKS, g->sdArrTicks);
+  for (int i = 0; steps < 0 || i < steps; i++) {
+    if (TryMove(g, 0, 1)) { g->score += r->softDropPoints * g->level; continue; }
+    if (r->lockDelayTicks == 0) LockCurrentPiece(g, r);
+    break;
+  }
+}
+
+/* ===================== GRID ===================== */
+
+static void GenerateGrid(GameState *g) {
+  RowWord *emptyRow = GameEmptyRow(g);
+  for (int w = 0; w < g->rowStride; w++) emptyRow[w] = ~(RowWord)0;
+  for (int x = 1; x < g->cols-1; x++) {
+    int b = x + BOARD_MARGIN;
+    emptyRow[b >> 6] &= ~((RowWord)1 << (b & 63));
+  }
+  uint16_t *rowSlotStore = GameRowSlot(g) - BOARD_PAD_TOP;
+  for (int i = 0; i < g->slots; i++) {
+    RowWord *row = GameRowStore(g) + (size_t)i * g->rowStride;
+    rowSlotStore[i] = (uint16_t)i;
+    if (i < BOARD_PAD_TOP + g->rows-1) memcpy(row, emptyRow, (size_t)g->rowStride * sizeof(RowWord));
+    else                               memset(row, 0xFF, (size_t)g->rowStride * sizeof(RowWord));
+    GameRowFill(g)[i] = 0;
+  }
+  memset(GameRowColors(g), 0, (size_t)g->slots * g->colorRowBytes);
+  memset(GameColHeight(g), 0, (size_t)g->cols * sizeof(int));
+  memset(GameRowHash(g), 0, (size_t)g->slots * sizeof(uint64_t));
+  g->stackHeight = 0;
+  g->boardHash   = 0;
+  g->pieceHash   = 0;
+}
+
+CellState CellAt(const GameState *g, int x, int y) {
+  if (x == 0 || x == g->cols-1 || y == g->rows-1) return BOARD_LIMIT;
+  return RowTest(BoardRow(g, y), x) ? PLACED_PIECE : EMPTY;
+}
+
+PiecesFormat CellPiece(const GameState *g, int x, int y) {
+  int c = (GameRowColors(g)[(size_t)GameRowSlot(g)[y] * g->colorRowBytes + (x >> 1)] >> ((x & 1) * 4)) & 0xF;
+  return c ? (PiecesFormat)(c - 1) : TETROMINO_COUNT;
+}
+/* ===================== STEP ===================== */
+
+/* One tick under ruleset r with the buttons held in input. Only ever
+   called with a constant r, from the per-ruleset steps below. */
+RULES_INLINE void StepRules(GameState *g, unsigned input, const Ruleset *r) {
+  g->events = 0;
+  if (g->itsOver) return;
+  unsigned pressed = input & ~g->input;
+  g->input = input;
+
+  if (g->clearingLines) {
+    g->blinkTickCounter++;
+    if (g->blinkTickCounter >= LINE_CLEAR_BLINK_EVERY) {
+      g->blinkTickCounter = 0;
+      g->blinkOn = !g->blinkOn;
+    }
+    g->clearTimerTicks--;
+    if (g->clearTimerTicks <= 0) {
+      ApplyLineClearNow(g, g->linesToClear, g->linesToClearCount);
+      ApplyScoring(g, r, g->linesToClearCount);
+      g->clearingLines     = false;
+      g->linesToClearCount = 0;
+      g->spawnDelayTicks   = r->spawnDelayTicks;
+    }
+    return;
+  }
+
+  if (!g->pieceActive) {
+    if (g->spawnDelayTicks > 0) { g->spawnDelayTicks--; return; }
+    GenerateRandomPiece(g);
+  }
+  if (g->itsOver) return;
+
+  ActivePiece before = g->cur;
+  if (g->pieceActive) {
+    HandleHorizontalInput(g);
+
+    if (pressed & INPUT_ROTATE_CW)  TryRotate(g, r, ROT_CW);
+    if (pressed & INPUT_ROTATE_CCW) TryRotate(g, r, ROT_CCW);
+    if (pressed & INPUT_HARD_DROP)  { HardDrop(g, r); return; }
+
+    HandleSoftDrop(g, r);
+  }
+
+  if (g->pieceActive) ApplyGravity(g, r);
+  if (g->pieceActive && r->lockDelayTicks > 0)
+    UpdateLockDelay(g, r, g->cur.x != before.x || g->cur.rot != before.rot);
+}
+
+#define RULESET_STEP(id, table) \
+  static void Step##id(GameState *g, unsigned input) { StepRules(g, input, &table); }
+RULESET_LIST(RULESET_STEP)
+#undef RULESET_STEP
+
+/* Per-ruleset tick functions. GameStep looks the game's up every tick;
+   GameStepFor hands it out so headless loops can do that once. */
+static const GameStepFn RULESET_STEPS[RULESET_COUNT] = {
+#define RULESET_STEP_ENTRY(id, table) [RULESET_##id] = Step##id,
+  RULESET_LIST(RULESET_STEP_ENTRY)
+#undef RULESET_STEP_ENTRY
+};
+
+void GameStep(GameState *g, unsigned input) {
+  RULESET_STEPS[g->ruleset](g, input);
+}
+
+GameStepFn GameStepFor(RulesetId ruleset) {
+  return RULESET_STEPS[ruleset];
+}
+
+unsigned GameEvents(const GameState *g) {
+  return g->events;
+}
+
+/* The geometry, preview count and handling are kept. */
+void GameInit(GameState *g, uint64_t seed, RulesetId ruleset, int startLevel) {
+  const Ruleset *r = RULESETS[ruleset];
+  g->ruleset      = ruleset;
+  g->randomizer   = r->randomizer;
+  g->itsOver      = false;
+  g->pieceActive  = false;
+  g->gravityAcc   = 0;
+  g->lockTicks    = 0;
+  g->lockResets   = 0;
+  g->spawnDelayTicks = 0;
+
+  g->input          = 0;
+  g->holdLeftTicks  = 0;
+  g->holdRightTicks = 0;
+  g->holdDownTicks  = 0;
+  g->downBlocked    = false;
+
+  g->clearingLines     = false;
+  g->clearTimerTicks   = 0;
+  g->linesToClearCount = 0;
+  g->blinkTickCounter  = 0;
+  g->blinkOn = false;
+  g->events  = 0;
+
+  g->score        = 0;
+  g->linesCleared = (startLevel - 1) * r->linesPerLevel;
+  g->level        = startLevel;
+  g->gravity      = RulesetGravity(r, g->level);
+
+  g->combo      = -1;
+  g->backToBack = false;
+
+  GenerateGrid(g);
+  SeedRandom(g, seed);
+  if (g->previewCount < 1)              g->previewCount = 1;
+  if (g->previewCount > QUEUE_CAPACITY) g->previewCount = QUEUE_CAPACITY;
+  g->queueHead  = 0;
+  g->queueCount = 0;
+  QueueFill(g);
+}
+
+/* Dealt pieces stay queued; raising the count deals more right away. */
+void GameSetPreviews(GameState *g, int count) {
+  if (count < 1)              count = 1;
+  if (count > QUEUE_CAPACITY) count = QUEUE_CAPACITY;
+  g->previewCount = count;
+  QueueFill(g);
+}
+
+static int ClampTicks(int t) {
+  return t < 0 ? 0 : t > MAX_HANDLING_TICKS ? MAX_HANDLING_TICKS : t;
+}
+
+void GameSetHandling(GameState *g, int das, int arr, int sdArr) {
+  g->dasTicks   = ClampTicks(das);
+  g->arrTicks   = ClampTicks(arr);
+  g->sdArrTicks = ClampTicks(sdArr);
+}
+
+/* ===================== QUERIES ===================== */
+
+int  GameCols(const GameState *g)        { return g->cols; }
+int  GameRows(const GameState *g)        { return g->rows; }
+int  GameScore(const GameState *g)       { return g->score; }
+int  GameLines(const GameState *g)       { return g->linesCleared; }
+int  GameLevel(const GameState *g)       { return g->level; }
+int  GameStackHeight(const GameState *g) { return g->stackHeight; }
+bool GameIsOver(const GameState *g)      { return g->itsOver; }
+int  GamePreviewCount(const GameState *g) { return g->previewCount; }
+
+int RowCellCount(const GameState *g, int y) {
+  return GameRowFill(g)[GameRowSlot(g)[y]];
+}
+
+int ColumnHeight(const GameState *g, int x) {
+  return GameColHeight(g)[x];
+}
+
+bool RowBlinking(const GameState *g, int y) {
+  if (!g->clearingLines || !g->blinkOn) return false;
+  for (int i = 0; i < g->linesToClearCount; i++)
+    if (g->linesToClear[i] == y) return true;
+  return false;
+}
+
+bool GameCurrentPiece(const GameState *g, ActivePiece *out) {
+  if (!g->pieceActive) return false;
+  *out = g->cur;
+  return true;
+}
+
+int GameDropDistance(const GameState *g) {
+  if (!g->pieceActive) return 0;
+  return DropDistance(g, g->cur.type, g->cur.rot, g->cur.x, g->cur.y);
+}
+
+void PieceCells(PiecesFormat t, int rot, int out[4][2]) {
+  memcpy(out, SHAPES[t][rot & 3], sizeof(SHAPES[t][rot & 3]));
+}
+
+const char *RulesetName(RulesetId id) {
+  return RULESETS[id]->name;
+}
+
+/* ===================== VIEWS ===================== */
+
+_Static_assert(sizeof(int) == sizeof(int32_t) && sizeof(unsigned) == sizeof(uint32_t)
+               && sizeof(PiecesFormat) == sizeof(int32_t) && sizeof(ActivePiece) == 4 * sizeof(int32_t),
+               "GameView exposes int fields as 32-bit");
+
+int EngineAbiVersion(void) {
+  return ENGINE_ABI_VERSION;
+}
+
+size_t GameGetView(const GameState *g, GameView *view, size_t viewSize) {
+  GameView v = {
+    .cols          = g->cols,
+    .rows          = g->rows,
+    .rowStride     = g->rowStride,
+    .bitOffset     = BOARD_MARGIN,
+    .colorRowBytes = g->colorRowBytes,
+    .queueCapacity = QUEUE_CAPACITY,
+    .rowStore      = GameRowStore(g),
+    .rowSlot       = GameRowSlot(g),
+    .rowFill       = GameRowFill(g),
+    .rowColors     = GameRowColors(g),
+    .colHeight     = (const int32_t *)GameColHeight(g),
+    .queue         = (const int32_t *)g->queue,
+    .queueHead     = (const uint32_t *)&g->queueHead,
+    .previewCount  = (const int32_t *)&g->previewCount,
+    .current       = &g->cur,
+    .pieceActive   = &g->pieceActive,
+    .score         = (const int32_t *)&g->score,
+    .lines         = (const int32_t *)&g->linesCleared,
+    .level         = (const int32_t *)&g->level,
+    .over          = &g->itsOver,
+    .events        = (const uint32_t *)&g->events,
+  };
+  if (viewSize > sizeof v) viewSize = sizeof v;
+  memcpy(view, &v, viewSize);
+  return sizeof v;
+}
+
+/* ===================== BATCHED ENVIRONMENTS ===================== */
+
+/* count games of one geometry and ruleset, for training agents. Everything
+   lives in one allocation: the struct, the game blocks back to back (copies
+   of one freshly created game, which is fine as they hold no pointers),
+   then the per-game result arrays, each indexed by game. Boards are not
+   interleaved across games: a step is a plain loop over the blocks. */
+struct VecEnv {
+  int       count;
+  int       cols;
+  RulesetId ruleset;
+  int       startLevel;
+  uint64_t  seed;
+  size_t    gameStride;     /* bytes from one game block to the next */
+
+  unsigned char *games;
+  int32_t  *reward;         /* score gained by the latest step */
+  int32_t  *finalScore;     /* score of the game that just ended, where done */
+  int32_t  *piece;          /* current piece type */
+  uint32_t *episode;        /* games started so far */
+  uint8_t  *done;           /* the latest step ended the game; a new one was started */
+};
+
+static inline GameState *EnvGame(const VecEnv *e, int i) {
+  return (GameState *)(e->games + (size_t)i * e->gameStride);
+}
+
+/* Game i's k-th episode plays seed + k*count + i, so no two games of an
+   environment ever share a piece sequence. */
+static void EnvNewEpisode(VecEnv *e, int i) {
+  GameState *g = EnvGame(e, i);
+  GameInit(g, e->seed + (uint64_t)e->episode[i]++ * (uint64_t)e->count + (uint64_t)i, e->ruleset, e->startLevel);
+  while (!g->pieceActive && !g->itsOver) RULESET_STEPS[e->ruleset](g, 0);
+  e->piece[i] = g->pieceActive ? (int32_t)g->cur.type : TETROMINO_COUNT;
+}
+
+VecEnv *VecEnvCreate(int count, int cols, int rows, RulesetId ruleset, int startLevel, uint64_t seed) {
+  if (count < 1) return NULL;
+  GameState *proto = GameCreate(cols, rows);
+  if (!proto) return NULL;
+
+  size_t head   = (sizeof(VecEnv) + 15) & ~(size_t)15;
+  size_t stride = ((size_t)proto->size + 15) & ~(size_t)15;
+  size_t n      = (size_t)count;
+  size_t size   = head + n * stride + n * (3 * sizeof(int32_t) + sizeof(uint32_t) + sizeof(uint8_t));
+  VecEnv *e = malloc(size);
+  if (!e) { GameDestroy(proto); return NULL; }
+
+  e->count      = count;
+  e->cols       = proto->cols;
+  e->ruleset    = ruleset;
+  e->startLevel = startLevel;
+  e->seed       = seed;
+  e->gameStride = stride;
+  e->games      = (unsigned char *)e + head;
+  e->reward     = (int32_t *)(e->games + n * stride);
+  e->finalScore = e->reward + n;
+  e->piece      = e->finalScore + n;
+  e->episode    = (uint32_t *)(e->piece + n);
+  e->done       = (uint8_t *)(e->episode + n);
+  for (int i = 0; i < count; i++) memcpy(EnvGame(e, i), proto, proto->size);
+  GameDestroy(proto);
+
+  VecEnvReset(e);
+  return e;
+}
+
+void VecEnvDestroy(VecEnv *e) {
+  free(e);
+}
+
+void VecEnvReset(VecEnv *e) {
+  for (int i = 0; i < e->count; i++) {
+    e->reward[i]     = 0;
+    e->finalScore[i] = 0;
+    e->done[i]       = 0;
+    e->episode[i]    = 0;
+    EnvNewEpisode(e, i);
+  }
+}
+
+/* Places the current piece for action rot * cols + x the way a player with
+   instant hands could: rotations (kicks included), shifts, then a hard
+   drop, all within one tick. A blocked path drops the piece where it got
+   stuck; an action out of range drops it as spawned. */
+RULES_INLINE void EnvPlace(GameState *g, const Ruleset *r, int32_t action) {
+  if (action >= 0 && action < 4 * g->cols) {
+    int rot = action / g->cols, x = action % g->cols;
+    int dir = ((rot - g->cur.rot) & 3) == 3 ? ROT_CCW : ROT_CW;
+    while (g->cur.rot != rot) {
+      int was = g->cur.rot;
+      TryRotate(g, r, dir);
+      if (g->cur.rot == was) break;
+    }
+    int dx = x < g->cur.x ? LEFT : RIGHT;
+    while (g->cur.x != x && TryMove(g, dx, 0)) {}
+  }
+  HardDrop(g, r);
+}
+
+/* One placement per game, then the delays run out (line clear, spawn) until
+   the next piece is in play. A game that ends is restarted at once. */
+RULES_INLINE void EnvStepRules(VecEnv *e, const int32_t *actions, const Ruleset *r) {
+  for (int i = 0; i < e->count; i++) {
+    GameState *g = EnvGame(e, i);
+    int before = g->score;
+    if (g->pieceActive) EnvPlace(g, r, actions[i]);
+    while (!g->pieceActive && !g->itsOver) StepRules(g, 0, r);
+    e->reward[i] = g->score - before;
+    e->done[i]   = g->itsOver;
+    if (g->itsOver) {
+      e->finalScore[i] = g->score;
+      EnvNewEpisode(e, i);
+    } else {
+      e->piece[i] = g->cur.type;
+    }
+  }
+}
+
+#define ENV_STEP(id, table) \
+  static void EnvStep##id(VecEnv *e, const int32_t *actions) { EnvStepRules(e, actions, &table); }
+RULESET_LIST(ENV_STEP)
+#undef ENV_STEP
+
+static void (*const ENV_STEPS[RULESET_COUNT])(VecEnv *e, const int32_t *actions) = {
+#define ENV_STEP_ENTRY(id, table) [RULESET_##id] = EnvStep##id,
+  RULESET_LIST(ENV_STEP_ENTRY)
+#undef ENV_STEP_ENTRY
+};
+
+void VecEnvStep(VecEnv *e, const int32_t *actions) {
+  ENV_STEPS[e->ruleset](e, actions);
+}
+
+/* Eight cells at a time: one multiply spreads bits 0..6 of a row chunk to
+   bit 0 of bytes 0..6 (the partial products never overlap, so no carries),
+   and bit 7 is moved by hand. */
+void VecEnvObserve(const VecEnv *e, uint8_t *out) {
+  for (int i = 0; i < e->count; i++) {
+    const GameState *g = EnvGame(e, i);
+    int width = g->cols - 2;
+    for (int y = 0; y < g->rows-1; y++) {
+      const RowWord *row = BoardRow(g, y);
+      for (int x = 0; x < width; x += 8) {
+        int b = x + 1 + BOARD_MARGIN;
+        RowWord bits = row[b >> 6] >> (b & 63);
+        if ((b & 63) > 56) bits |= row[(b >> 6) + 1] << (64 - (b & 63));
+        uint64_t spread = ((bits & 0x7F) * 0x0002040810204081ull & 0x0101010101010101ull)
+                        | (bits >> 7 & 1) << 56;
+        int n = width - x < 8 ? width - x : 8;
+        for (int k = 0; k < n; k++) out[x + k] = (uint8_t)(spread >> (8 * k));
+      }
+      out += width;
+    }
+  }
+}
+
+int       VecEnvCount(const VecEnv *e)           { return e->count; }
+GameState *VecEnvGame(VecEnv *e, int i)          { return EnvGame(e, i); }
+const int32_t *VecEnvRewards(const VecEnv *e)    { return e->reward; }
+const uint8_t *VecEnvDones(const VecEnv *e)      { return e->done; }
+const int32_t *VecEnvFinalScores(const VecEnv *e) { return e->finalScore; }
+const int32_t *VecEnvPieces(const VecEnv *e)     { return e->piece; }
+
+/* ===================== BENCHMARK ===================== */
+
+#ifdef RAYBLOCKS_BENCH
+#define BENCH_BYTES 2000000000.0
+
+static const int BENCH_SIZES[][2] = { { 10, 20 }, { 20, 40 }, { 40, 100 }, { 256, 1000 } };
+#define BENCH_SIZE_COUNT ((int)(sizeof(BENCH_SIZES) / sizeof(BENCH_SIZES[0])))
+
+/* Snapshot and restore throughput for each board size. */
+static void BenchSnapshots(void) {
+  for (int i = 0; i < BENCH_SIZE_COUNT; i++) {
+    GameState *g = GameCreate(BENCH_SIZES[i][0] + 2, BENCH_SIZES[i][1] + 1);
+    void *snap = g ? malloc(GameSnapshotSize(g)) : NULL;
+    if (!snap) { GameDestroy(g); continue; }
+    GameInit(g, 1, RULESET_RAYBLOCKS, 1);
+    long iters = (long)(BENCH_BYTES / g->size);
+    if (iters < 1000) iters = 1000;
+
+    clock_t t0 = clock();
+    for (long n = 0; n < iters; n++) { g->gravityAcc = (int)n; GameSnapshot(g, snap); }
+    clock_t t1 = clock();
+    for (long n = 0; n < iters; n++) { ((GameState *)snap)->score = (int)n; GameRestore(g, snap); }
+    clock_t t2 = clock();
+
+    double snapSec    = (double)(t1 - t0) / CLOCKS_PER_SEC;
+    double restoreSec = (double)(t2 - t1) / CLOCKS_PER_SEC;
+    printf("%4d x %-4d %8u bytes  %10.0f snapshots/s  %10.0f restores/s  (score %d)\n",
+           BENCH_SIZES[i][0], BENCH_SIZES[i][1], (unsigned)g->size,
+           snapSec    > 0.0 ? iters / snapSec    : 0.0,
+           restoreSec > 0.0 ? iters / restoreSec : 0.0, g->score);
+    free(snap);
+    GameDestroy(g);
+  }
+}
+
+/* Nanoseconds per piece dealt by each randomizer. */
+static void BenchRandomizers(void) {
+  static const char *names[RANDOMIZER_COUNT] = { "7-bag", "reroll", "pure" };
+  GameState *g = GameCreate(12, 21);
+  if (!g) return;
+  for (int r = 0; r < RANDOMIZER_COUNT; r++) {
+    GameInit(g, 1, RULESET_RAYBLOCKS, 1);
+    g->randomizer = (Randomizer)r;
+    SeedRandom(g, 1);
+    const long iters = 100000000;
+    long counts[TETROMINO_COUNT] = {0};
+    clock_t t0 = clock();
+    for (long n = 0; n < iters; n++) counts[RandomType(g)]++;
+    double sec = (double)(clock() - t0) / CLOCKS_PER_SEC;
+    printf("%-7s %6.2f ns/piece  (I share %.4f)\n", names[r], sec * 1e9 / iters, (double)counts[I] / iters);
+  }
+  GameDestroy(g);
+}
+
+/* Environment steps per second with uniformly random actions, with and
+   without reading the boards back after every step. */
+static void BenchEnvs(void) {
+  enum { ENVS = 256, STEPS = 4000 };
+  for (int r = 0; r < RULESET_COUNT; r++) {
+    VecEnv *e = VecEnvCreate(ENVS, 12, 21, (RulesetId)r, 1, 1);
+    uint8_t *obs = malloc((size_t)ENVS * 20 * 10);
+    if (!e || !obs) { VecEnvDestroy(e); free(obs); return; }
+    static int32_t actions[ENVS];
+    uint64_t rng = 1;
+    long games = 0;
+    double sec[2];
+    for (int observe = 0; observe < 2; observe++) {
+      clock_t t0 = clock();
+      for (int n = 0; n < STEPS; n++) {
+        for (int i = 0; i < ENVS; i++) actions[i] = (int32_t)(SplitMix64(&rng) % ENV_ACTION_COUNT(12));
+        VecEnvStep(e, actions);
+        if (observe) VecEnvObserve(e, obs);
+        for (int i = 0; i < ENVS; i++) games += VecEnvDones(e)[i];
+      }
+      sec[observe] = (double)(clock() - t0) / CLOCKS_PER_SEC;
+    }
+    printf("%-9s %10.0f env steps/s  %10.0f with boards  (%ld games)\n", RulesetName((RulesetId)r),
+           sec[0] > 0.0 ? ENVS * (double)STEPS / sec[0] : 0.0,
+           sec[1] > 0.0 ? ENVS * (double)STEPS / sec[1] : 0.0, games);
+    free(obs);
+    VecEnvDestroy(e);
+  }
+}
+
+/* ./build.sh bench builds the engine alone around this main. */
+int main(void) {
+  EngineInit();
+  BenchSnapshots();
+  BenchRandomizers();
+  BenchEnvs();
+  return 0;
+}
+#endif
@@ -0,0 +1,232 @@
+/* Programmed by edutavr */
+
+/* RayBlocks engine: board, pieces, rules and scoring, with no window, input
+   device or audio. A game only moves forward through GameStep, one fixed
+   tick per call, and reports what happened as GameEvent bits; everything a
+   client draws is read through the queries below. */
+
+#ifndef RAYBLOCKS_ENGINE_H
+#define RAYBLOCKS_ENGINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* ===================== CONFIG ===================== */
+
+#define MAX_BOARD_COLS (256 + 2)
+#define MAX_BOARD_ROWS (1000 + 1)
+#define SIM_TICK_RATE 60          /* GameStep calls per second of play */
+#define GRAVITY_ONE (1 << 16)     /* fixed-point gravity: one row per tick (1G) */
+#define QUEUE_CAPACITY 16         /* most pieces a game can deal ahead */
+#define DEFAULT_PREVIEWS 5
+#define DEFAULT_DAS_TICKS 12      /* the first auto-repeat, 0.2 s after the press */
+#define DEFAULT_ARR_TICKS 3
+#define DEFAULT_SD_ARR_TICKS 2
+#define MAX_HANDLING_TICKS 255
+#define ENGINE_ABI_VERSION 1      /* bumped on any change that breaks existing callers */
+
+/* ===================== TYPES ===================== */
+
+typedef enum CellState {
+  EMPTY, MOVING_PIECE, PLACED_PIECE, CLEAN_LINE, BOARD_LIMIT
+} CellState;
+
+typedef enum PiecesFormat {
+  I, O, T, S, Z, J, L, TETROMINO_COUNT
+} PiecesFormat;
+
+/* Every ruleset: X(id, table), table being its Ruleset in engine.c. Adding
+   one is a table there plus a line here. */
+#define RULESET_LIST(X)            \
+  X(RAYBLOCKS, rulesetRayblocks)   \
+  X(GUIDELINE, rulesetGuideline)   \
+  X(NES,       rulesetNes)
+
+typedef enum RulesetId {
+#define RULESET_ENUM(id, table) RULESET_##id,
+  RULESET_LIST(RULESET_ENUM)
+#undef RULESET_ENUM
+  RULESET_COUNT
+} RulesetId;
+
+typedef struct ActivePiece {
+  PiecesFormat type;
+  int rot;
+  int x;
+  int y;
+} ActivePiece;
+
+/* Buttons held during one simulation tick. The game only ever sees these,
+   so the same sequence of inputs always plays out the same way. */
+typedef enum InputBits {
+  INPUT_LEFT       = 1 << 0,
+  INPUT_RIGHT      = 1 << 1,
+  INPUT_SOFT_DROP  = 1 << 2,
+  INPUT_HARD_DROP  = 1 << 3,
+  INPUT_ROTATE_CW  = 1 << 4,
+  INPUT_ROTATE_CCW = 1 << 5
+} InputBits;
+
+/* What one GameStep did, for clients to react to (sounds, stats...). */
+typedef enum GameEvent {
+  EVENT_LOCK       = 1 << 0,  /* the piece locked into the stack */
+  EVENT_LINE_CLEAR = 1 << 1,  /* the lock filled lines; they clear after the delay */
+  EVENT_TETRIS     = 1 << 2,  /* ... and there were four of them */
+  EVENT_GAME_OVER  = 1 << 3   /* the next piece had no room to spawn */
+} GameEvent;
+
+/* One running game: a single pointer-free block (see GameSnapshot). */
+typedef struct GameState GameState;
+
+/* ===================== LIFECYCLE ===================== */
+
+/* Builds the shared piece and hash tables; call once before anything else. */
+void EngineInit(void);
+
+/* cols/rows include the walls and the floor row; NULL if out of memory. */
+GameState *GameCreate(int cols, int rows);
+void       GameDestroy(GameState *g);
+
+/* Back to an empty board at startLevel under ruleset. seed fixes every piece
+   the game will deal, so seed, ruleset and the inputs replay a game exactly. */
+void GameInit(GameState *g, uint64_t seed, RulesetId ruleset, int startLevel);
+
+/* Pieces kept dealt ahead, 1..QUEUE_CAPACITY. */
+void GameSetPreviews(GameState *g, int count);
+
+/* Auto-repeat in ticks, 0..MAX_HANDLING_TICKS: a held left/right moves on
+   the press, again das ticks later and then every arr ticks (arr 0 slides
+   all the way at once); soft drop moves every sdArr ticks. A new game
+   starts with the DEFAULT_ values. */
+void GameSetHandling(GameState *g, int das, int arr, int sdArr);
+
+/* One tick with the InputBits held during it. */
+void     GameStep(GameState *g, unsigned input);
+unsigned GameEvents(const GameState *g);  /* GameEvent bits of the latest step */
+
+/* GameStep compiled for one ruleset, with its rules folded in. Looked up
+   once, it spares a headless loop GameStep's per-tick dispatch; only call it
+   on games initialised with that ruleset. */
+typedef void (*GameStepFn)(GameState *g, unsigned input);
+GameStepFn GameStepFor(RulesetId ruleset);
+
+/* ===================== QUERIES ===================== */
+
+int  GameCols(const GameState *g);
+int  GameRows(const GameState *g);
+int  GameScore(const GameState *g);
+int  GameLines(const GameState *g);
+int  GameLevel(const GameState *g);
+int  GameStackHeight(const GameState *g);  /* tallest column, in rows above the floor */
+bool GameIsOver(const GameState *g);
+
+CellState    CellAt(const GameState *g, int x, int y);
+PiecesFormat CellPiece(const GameState *g, int x, int y);  /* TETROMINO_COUNT if none */
+int          RowCellCount(const GameState *g, int y);      /* placed cells in row y */
+int          ColumnHeight(const GameState *g, int x);      /* filled height of column x above the floor */
+bool         RowBlinking(const GameState *g, int y);       /* a clearing row in its lit phase */
+
+/* False while no piece is in play (spawn delay, line clear, game over). */
+bool GameCurrentPiece(const GameState *g, ActivePiece *out);
+int  GameDropDistance(const GameState *g);  /* rows the current piece can still fall */
+
+int          GamePreviewCount(const GameState *g);
+PiecesFormat QueuePeek(const GameState *g, int i);  /* i-th upcoming piece, 0 = next */
+
+/* Cell offsets of a piece orientation from its (x, y). */
+void PieceCells(PiecesFormat t, int rot, int out[4][2]);
+
+const char *RulesetName(RulesetId id);
+
+/* ===================== SNAPSHOTS ===================== */
+
+/* Fingerprint of the position: board, current piece and previewed pieces. */
+uint64_t GameHash(const GameState *g);
+
+/* A snapshot buffer must be aligned like a GameState: malloc'd memory is,
+   and so is every 16th byte of it when packing several. */
+size_t GameSnapshotSize(const GameState *g);
+void   GameSnapshot(const GameState *g, void *out);
+bool   GameRestore(GameState *g, const void *snapshot);
+
+/* ===================== VIEWS ===================== */
+
+/* The engine also builds as a shared library (./build.sh shared) whose ABI
+   is this header: plain functions over an opaque GameState, fixed-size
+   fields in every struct, and GameView only ever grows at the end. */
+int EngineAbiVersion(void);  /* ENGINE_ABI_VERSION the library was built with */
+
+/* Read-only pointers straight into a game's memory, so bindings (numpy...)
+   can map the live state instead of asking for it call by call. They stay
+   valid, and keep following the game, until GameDestroy. Board row y
+   (0 = top, rows-1 = floor) is the rowStride words at
+   rowStore + rowSlot[y] * rowStride, with column x at bit x + bitOffset;
+   colours are 4 bits per cell (0 = none, else PiecesFormat + 1) at
+   rowColors + rowSlot[y] * colorRowBytes. */
+typedef struct GameView {
+  int32_t cols;
+  int32_t rows;
+  int32_t rowStride;
+  int32_t bitOffset;
+  int32_t colorRowBytes;
+  int32_t queueCapacity;
+
+  const uint64_t *rowStore;
+  const uint16_t *rowSlot;      /* rows entries */
+  const uint16_t *rowFill;      /* placed cells, indexed by slot */
+  const uint8_t  *rowColors;
+  const int32_t  *colHeight;    /* cols entries */
+
+  const int32_t  *queue;        /* upcoming piece i is queue[(*queueHead + i) % queueCapacity] */
+  const uint32_t *queueHead;
+  const int32_t  *previewCount;
+
+  const ActivePiece *current;   /* meaningful while *pieceActive */
+  const bool        *pieceActive;
+  const int32_t     *score;
+  const int32_t     *lines;
+  const int32_t     *level;
+  const bool        *over;
+  const uint32_t    *events;
+} GameView;
+
+/* Fills the first viewSize bytes of *view (pass sizeof(GameView)) and
+   returns the library's own sizeof(GameView), so callers built against an
+   older header keep working. */
+size_t GameGetView(const GameState *g, GameView *view, size_t viewSize);
+
+/* ===================== BATCHED ENVIRONMENTS ===================== */
+
+/* count games of one size and ruleset, advanced one placement per step for
+   training agents. The games are whole GameState blocks side by side
+   (array of structs) and a step plays them one after another; each game's
+   own rows are bitboards, so collision and line checks stay word-parallel.
+   Results come back as arrays indexed by game, valid until the next step. */
+typedef struct VecEnv VecEnv;
+
+/* Actions per game: action rot * cols + x drops the current piece at
+   orientation rot and column x (cols including the walls, as GameCols). */
+#define ENV_ACTION_COUNT(cols) (4 * (cols))
+
+/* Game i's k-th game plays seed + k*count + i. NULL if out of memory. */
+VecEnv *VecEnvCreate(int count, int cols, int rows, RulesetId ruleset, int startLevel, uint64_t seed);
+void    VecEnvDestroy(VecEnv *e);
+void    VecEnvReset(VecEnv *e);  /* every game back to its first seed */
+
+/* One placement per game, actions[i] for game i, then ticks until the next
+   piece is in play. A game that ends is flagged done and restarted. */
+void VecEnvStep(VecEnv *e, const int32_t *actions);
+
+/* Boards as count * (rows-1) * (cols-2) bytes, game by game, row by row
+   from the top: 1 = filled cell. Walls and floor are left out. */
+void VecEnvObserve(const VecEnv *e, uint8_t *out);
+
+int        VecEnvCount(const VecEnv *e);
+GameState *VecEnvGame(VecEnv *e, int i);            /* for the queries above */
+const int32_t *VecEnvRewards(const VecEnv *e);      /* score gained by the latest step */
+const uint8_t *VecEnvDones(const VecEnv *e);        /* 1 where the latest step ended the game */
+const int32_t *VecEnvFinalScores(const VecEnv *e);  /* where done, the ended game's score */
+const int32_t *VecEnvPieces(const VecEnv *e);       /* current piece type */
+
+#endif
@@ -1,44 +1,51 @@
 /* Programmed by edutavr */
 
 #include "raylib.h"
+#include "engine.h"
+#include "replay.h"
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "icon_data.h"
 
 /* ===================== CONFIG ===================== */
 
-#define COLS 12
-#define ROWS 21
 #define BOARD_X_AXIS 50
 #define BOARD_Y_AXIS 70
+#define BOARD_AREA_W 310
+#define BOARD_AREA_H 515
 #define SQUARE_SIZE 24
-#define LEFT  -1
-#define RIGHT  1
-#define SPAWN_DELAY_FRAMES 15
+#define DETAIL_MIN_CELL 4.0f
+#define MAX_CATCHUP_TICKS 10      /* ticks run in one frame before the backlog is dropped */
 #define PAGE_SIZE 10
 #define MAX_SCORES 200
 #define MAX_NAME_LEN 16
 #define LEADERBOARD_FILE "leaderboard.dat"
 #define KEYBINDS_FILE    "keybinds.dat"
 #define KEYBIND_COUNT    7
+#define HANDLING_FILE    "handling.dat"
+#define HANDLING_COUNT   3
+#define MAX_HANDLING_SETTING 30  /* ticks; the settings screen wraps past it */
+#define REPLAY_FILE_NAME "replay-%Y%m%d-%H%M%S"  /* strftime format, local time of the game's start */
+#define REPLAY_FILE_EXT  ".rbr"
+#define REPLAY_NAME_TRIES 100  /* -2, -3... suffixes tried when games start in the same second */
+#define REPLAY_MIN_SPEED  0.25f
+#define REPLAY_MAX_SPEED  64.0f
+#define REPLAY_SKIP_TICKS (5 * SIM_TICK_RATE)  /* Left/Right in the replay viewer */
 //#define GAMEPAD_ID       0
 #define MIN_START_LEVEL 1
 #define MAX_START_LEVEL 19
+#define MIN_PREVIEWS 1
+#define MAX_PREVIEWS 6            /* shown in the HUD; the queue itself holds up to QUEUE_CAPACITY */
+#define DANGER_ROWS      7
 
 /* ===================== TYPES ===================== */
 
-typedef enum CellState {
-  EMPTY, MOVING_PIECE, PLACED_PIECE, CLEAN_LINE, BOARD_LIMIT
-} CellState;
-
-typedef enum PiecesFormat {
-  I, O, T, S, Z, J, L, TETROMINO_COUNT
-} PiecesFormat;
-
 typedef enum MainMenu {
-  MAINSCREEN = 0, GAMEPLAY, SCORES, SETTINGS
+  MAINSCREEN = 0, GAMEPLAY, SCORES, SETTINGS, REPLAY
 } MainMenu;
 
 typedef enum ThemeOptions {
@@ -52,12 +59,17 @@ typedef struct ThemeColors {
   const char *name;
 } ThemeColors;
 
-typedef struct ActivePiece {
-  PiecesFormat type;
-  int rot;
-  int x;
-  int y;
-} ActivePiece;
+typedef struct BoardSize {
+  int width;
+  int height;
+} BoardSize;
+
+/* Where the board is drawn; cell size shrinks to fit large boards. */
+typedef struct BoardLayout {
+  float x;
+  float y;
+  float cell;
+} BoardLayout;
 
 typedef struct ScoreEntry {
   char name[MAX_NAME_LEN];
@@ -86,6 +98,13 @@ typedef struct Keybinds {
   Binding pause;
 } Keybinds;
 
+/* Auto-repeat, in simulation ticks (see GameSetHandling). */
+typedef struct Handling {
+  int das;
+  int arr;
+  int sdArr;
+} Handling;
+
 typedef enum SettingsFlow {
   SF_IDLE = 0,
   SF_WAITING_KEY,
@@ -94,37 +113,37 @@ typedef enum SettingsFlow {
 
 /* ===================== GLOBAL STATE ===================== */
 
-static CellState grid[COLS][ROWS];
-
-static float holdLeftTime  = 0.0f;
-static float holdRightTime = 0.0f;
-static int   spawnDelayFrames = 0;
-
-static const float DAS = 0.15f;
-static const float ARR = 0.05f;
+/* The running game; NULL until the first Play. */
+static GameState *game = NULL;
 
-static bool itsOver = false;
+/* Fixed-step clock: real time not yet simulated, and presses seen since the
+   last tick so a tap between two ticks still reaches the game. */
+static double   simAccumulator = 0.0;
+static unsigned simPresses     = 0;
 
-static int frameCounter = 0;
-static int scrollSpeed  = 1;
 static int startLevel = 1;
 static bool prevHoverLevel = false;
+static int boardSizeIndex = 0;
+static bool prevHoverBoard = false;
+static int previewCount = DEFAULT_PREVIEWS;
+static bool prevHoverPreview = false;
+static RulesetId rulesetIndex = RULESET_RAYBLOCKS;
+static bool prevHoverRules = false;
+static bool recordReplays = false;
+static ReplayRecorder *recorder = NULL;  /* the running game's replay, if recorded */
+static char lastReplayPath[64] = "";     /* latest replay recorded this session */
+
+/* --- Replay viewer --- */
+static ReplayPlayer *viewer = NULL;
+static float  viewerSpeed       = 1.0f;
+static bool   viewerPaused      = false;
+static bool   viewerScrubbing   = false;
+static double viewerAccumulator = 0.0;
 static bool gamePaused = false;
 static float pauseCooldown = 0.0f;
 static bool prevHoverMute = false;
 static bool hMute = false;
 
-static int score        = 0;
-static int linesCleared = 0;
-static int level        = 1;
-
-static int  combo     = -1;
-static bool backToBack = false;
-
-static PiecesFormat nextType;
-static ActivePiece  cur;
-static bool         pieceActive = false;
-
 static GameOverFlow goFlow    = GO_SHOW_GAMEOVER;
 static char         nameInput[MAX_NAME_LEN] = {0};
 static int          nameLen = 0;
@@ -149,22 +168,6 @@ static bool  sfxTickReady      = false;
 static Sound sfxGameOver;
 static bool  sfxGameOverReady = false;
 
-/* --- Soft drop --- */
-static float holdDownTime = 0.0f;
-static bool  downBlocked  = false;
-static const float SD_DAS = 0.00f;
-static const float SD_ARR = 0.03f;
-
-/* --- Line clear animation --- */
-static bool clearingLines    = false;
-static int  clearTimerFrames = 0;
-#define LINE_CLEAR_DELAY_FRAMES 20
-#define LINE_CLEAR_BLINK_EVERY   6
-static int  blinkFrameCounter  = 0;
-static bool blinkOn            = false;
-static int  linesToClear[4];
-static int  linesToClearCount  = 0;
-
 /* --- Keybinds --- */
 static Keybinds keys = {
   /* moveLeft   */ { KEY_LEFT,  -1 },
@@ -176,6 +179,11 @@ static Keybinds keys = {
   /* pause */      { KEY_P,     -1 },
 };
 
+static Handling handling = { DEFAULT_DAS_TICKS, DEFAULT_ARR_TICKS, DEFAULT_SD_ARR_TICKS };
+
+static const char *handlingLabels[HANDLING_COUNT] = { "DAS", "ARR", "SD ARR" };
+static const int   HANDLING_X[HANDLING_COUNT]     = { 160, 390, 530 };  /* under the column headers */
+
 static SettingsFlow settingsFlow   = SF_IDLE;
 static int          rebindingIndex = -1;
 static bool         rebindingGP    = false; /* true = waiting gamepad, false = waiting keyboard */
@@ -198,63 +206,25 @@ static bool prevHoverClear[PAGE_SIZE];
 static bool prevHoverKbBtns[KEYBIND_COUNT];
 static bool prevHoverGpBtns[KEYBIND_COUNT];
 static bool prevHoverReset     = false;
+static bool prevHoverHandling[HANDLING_COUNT];
 
-/* ===================== SHAPES ===================== */
-
-static const int SHAPES[TETROMINO_COUNT][4][4][2] = {
-  /* I */
-  {
-    {{-1,0},{0,0},{1,0},{2,0}},
-    {{1,-1},{1,0},{1,1},{1,2}},
-    {{-1,1},{0,1},{1,1},{2,1}},
-    {{0,-1},{0,0},{0,1},{0,2}},
-  },
-  /* O */
-  {
-    {{0,0},{1,0},{0,1},{1,1}},
-    {{0,0},{1,0},{0,1},{1,1}},
-    {{0,0},{1,0},{0,1},{1,1}},
-    {{0,0},{1,0},{0,1},{1,1}},
-  },
-  /* T */
-  {
-    {{-1,0},{0,0},{1,0},{0,1}},
-    {{0,-1},{0,0},{0,1},{1,0}},
-    {{-1,0},{0,0},{1,0},{0,-1}},
-    {{0,-1},{0,0},{0,1},{-1,0}},
-  },
-  /* S */
-  {
-    {{0,0},{1,0},{-1,1},{0,1}},
-    {{0,-1},{0,0},{1,0},{1,1}},
-    {{0,0},{1,0},{-1,1},{0,1}},
-    {{0,-1},{0,0},{1,0},{1,1}},
-  },
-  /* Z */
-  {
-    {{-1,0},{0,0},{0,1},{1,1}},
-    {{1,-1},{0,0},{1,0},{0,1}},
-    {{-1,0},{0,0},{0,1},{1,1}},
-    {{1,-1},{0,0},{1,0},{0,1}},
-  },
-  /* J */
-  {
-    {{-1,0},{0,0},{1,0},{-1,1}},
-    {{0,-1},{0,0},{0,1},{1,1}},
-    {{-1,0},{0,0},{1,0},{1,-1}},
-    {{0,-1},{0,0},{0,1},{-1,-1}},
-  },
-  /* L */
-  {
-    {{-1,0},{0,0},{1,0},{1,1}},
-    {{0,-1},{0,0},{0,1},{1,-1}},
-    {{-1,0},{0,0},{1,0},{-1,-1}},
-    {{0,-1},{0,0},{0,1},{-1,1}},
-  },
+static const BoardSize BOARD_SIZES[] = {
+  { 10, 20 }, { 20, 40 }, { 40, 100 }, { 256, 1000 },
 };
+#define BOARD_SIZE_COUNT ((int)(sizeof(BOARD_SIZES) / sizeof(BOARD_SIZES[0])))
 
 /* ===================== COLOR HELPERS ===================== */
 
+static const Color PIECE_COLORS[TETROMINO_COUNT] = {
+  [I] = { 0, 220, 230, 255 },
+  [O] = { 240, 210, 0, 255 },
+  [T] = { 170, 60, 220, 255 },
+  [S] = { 60, 210, 70, 255 },
+  [Z] = { 230, 50, 60, 255 },
+  [J] = { 40, 90, 230, 255 },
+  [L] = { 245, 140, 20, 255 },
+};
+
 static Color Mix(Color a, Color b, float t) {
   if (t < 0.0f) t = 0.0f;
   if (t > 1.0f) t = 1.0f;
@@ -346,6 +316,31 @@ static void LoadKeybinds(void) {
   fclose(f);
 }
 
+static void SaveHandling(void) {
+  FILE *f = fopen(HANDLING_FILE, "wb");
+  if (!f) return;
+  fwrite(&handling, sizeof(Handling), 1, f);
+  fclose(f);
+}
+
+static int ClampHandlingSetting(int t) {
+  return t < 0 ? 0 : t > MAX_HANDLING_SETTING ? MAX_HANDLING_SETTING : t;
+}
+
+/* A short or unreadable file keeps the defaults; values are kept in the
+   range the settings screen steps through. */
+static void LoadHandling(void) {
+  FILE *f = fopen(HANDLING_FILE, "rb");
+  if (!f) return;
+  Handling h;
+  bool ok = fread(&h, sizeof(Handling), 1, f) == 1;
+  fclose(f);
+  if (!ok) return;
+  handling.das   = ClampHandlingSetting(h.das);
+  handling.arr   = ClampHandlingSetting(h.arr);
+  handling.sdArr = ClampHandlingSetting(h.sdArr);
+}
+
 /* ===================== KEYBIND HELPERS ===================== */
 
 static int GetActiveGamepadId(void) {
@@ -368,6 +363,15 @@ static Binding *BindingByIndex(int i) {
   }
 }
 
+static int *HandlingByIndex(int i) {
+  switch (i) {
+  case 0: return &handling.das;
+  case 1: return &handling.arr;
+  case 2: return &handling.sdArr;
+  default: return NULL;
+  }
+}
+
 static const char *KeyName(KeyboardKey k) {
   switch (k) {
     case KEY_LEFT:         return "LEFT";
@@ -434,8 +438,17 @@ static bool BindingPressed(Binding b) {
   return false;
 }
 
-
-
+/* InputBits for the game bindings that pass test (BindingDown or BindingPressed). */
+static unsigned ReadGameInput(bool (*test)(Binding)) {
+  unsigned input = 0;
+  if (test(keys.moveLeft))  input |= INPUT_LEFT;
+  if (test(keys.moveRight)) input |= INPUT_RIGHT;
+  if (test(keys.softDrop))  input |= INPUT_SOFT_DROP;
+  if (test(keys.hardDrop))  input |= INPUT_HARD_DROP;
+  if (test(keys.rotateCW))  input |= INPUT_ROTATE_CW;
+  if (test(keys.rotateCCW)) input |= INPUT_ROTATE_CCW;
+  return input;
+}
 
 /* ===================== AUDIO ===================== */
 
@@ -497,11 +510,15 @@ static void UnloadGameAudio(void) {
   audioReady = false;
 }
 
-static bool IsDangerZone(void) {
-  for (int y = 0; y <= 6; y++)
-    for (int x = 1; x < COLS-1; x++)
-      if (grid[x][y] == PLACED_PIECE) return true;
-  return false;
+static bool IsDangerZone(const GameState *g) {
+  return GameStackHeight(g) >= GameRows(g) - DANGER_ROWS;
+}
+
+/* Sound effects for the GameEvent bits of the latest frame's ticks. */
+static void PlayEventSounds(unsigned events) {
+  if (!sfxLineClearReady) return;
+  if (events & EVENT_TETRIS)          PlaySound(sfxTetris);
+  else if (events & EVENT_LINE_CLEAR) PlaySound(sfxLineClear);
 }
 
 static void StartGameplayMusic(void) {
@@ -545,390 +562,236 @@ static void SetMusicMuted(bool mute) {
     }
 }
 
-static void UpdateGameplayMusic(void) {
+static void UpdateGameplayMusic(const GameState *g) {
   if (!audioReady) return;
   if (playingFast) UpdateMusicStream(musicFast);
   else             UpdateMusicStream(musicNormal);
-  if (!itsOver) {
-    if (IsDangerZone()) SwitchToFastMusic();
+  if (!GameIsOver(g)) {
+    if (IsDangerZone(g)) SwitchToFastMusic();
     else                SwitchToNormalMusic();
   } else {
     StopGameplayMusic();
   }
 }
 
-/* ===================== ENGINE HELPERS ===================== */
-
-static bool CanPlace(PiecesFormat t, int rot, int px, int py) {
-  for (int i = 0; i < 4; i++) {
-    int gx = px + SHAPES[t][rot][i][0];
-    int gy = py + SHAPES[t][rot][i][1];
-    if (gx < 1 || gx >= COLS-1) return false;
-    if (gy >= ROWS) return false;
-    if (gy < 0) continue;
-    if (grid[gx][gy] == BOARD_LIMIT || grid[gx][gy] == PLACED_PIECE) return false;
-  }
-  return true;
-}
-
-static PiecesFormat RandomType(void) {
-  static PiecesFormat last = TETROMINO_COUNT;
-  PiecesFormat t = (PiecesFormat)GetRandomValue(0, TETROMINO_COUNT-1);
-  if (t == last) t = (PiecesFormat)GetRandomValue(0, TETROMINO_COUNT-1);
-  last = t;
-  return t;
-}
-
-static int FindFullLines(int outLines[4]) {
-  int count = 0;
-  for (int y = 0; y < ROWS-1; y++) {
-    bool full = true;
-    for (int x = 1; x < COLS-1; x++)
-      if (grid[x][y] != PLACED_PIECE) { full = false; break; }
-    if (full && count < 4) outLines[count++] = y;
-  }
-  return count;
-}
-
-static void ApplyLineClearNow(const int clearLines[4], int clearCount) {
-  if (clearCount <= 0) return;
-  bool toClear[ROWS] = {0};
-  for (int i = 0; i < clearCount; i++) {
-    int y = clearLines[i];
-    if (y >= 0 && y < ROWS-1) toClear[y] = true;
-  }
-  int writeRow = ROWS-2;
-  for (int readRow = ROWS-2; readRow >= 0; readRow--) {
-    if (toClear[readRow]) continue;
-    if (writeRow != readRow)
-      for (int x = 1; x < COLS-1; x++)
-        grid[x][writeRow] = grid[x][readRow];
-    writeRow--;
-  }
-  for (int y = writeRow; y >= 0; y--)
-    for (int x = 1; x < COLS-1; x++)
-      grid[x][y] = EMPTY;
-}
-
-/* ===================== SCORING ===================== */
-
-static void ApplyScoring(int clearedThisMove) {
-  int add = 0;
-  if (clearedThisMove > 0) {
-    linesCleared += clearedThisMove;
-    level = 1 + (linesCleared / 10);
-  }
-  switch (clearedThisMove) {
-    case 1: add = 100 * level; break;
-    case 2: add = 300 * level; break;
-    case 3: add = 500 * level; break;
-    case 4: add = 800 * level; break;
-    default: add = 0; break;
-  }
-  if (clearedThisMove == 4) {
-    if (backToBack) add += add / 2;
-    backToBack = true;
-  } else if (clearedThisMove > 0) {
-    backToBack = false;
-  }
-  if (clearedThisMove > 0) {
-    combo++;
-    if (combo > 0) add += (50 * combo * level);
-  } else {
-    combo = -1;
-  }
-  score += add;
-  if (level < 10) scrollSpeed = 1 + (level - 1); 
-  else if (level <= 12) scrollSpeed = 12;
-  else if (level <= 15) scrollSpeed = 15;
-  else if (level <= 18) scrollSpeed = 20;
-  else if (level <= 28) scrollSpeed = 30;
-  else                  scrollSpeed = 60;
-  frameCounter = 0;
-}
-
-/* ===================== PIECE ACTIONS ===================== */
-
-static void LockCurrentPiece(void) {
-  for (int i = 0; i < 4; i++) {
-    int gx = cur.x + SHAPES[cur.type][cur.rot][i][0];
-    int gy = cur.y + SHAPES[cur.type][cur.rot][i][1];
-    if (gy >= 0) grid[gx][gy] = PLACED_PIECE;
-  }
-  pieceActive = false;
-
-  if (BindingDown(keys.softDrop)) {
-    downBlocked = true;
-    holdDownTime = 0.0f;
-  }
-
-  linesToClearCount = FindFullLines(linesToClear);
-  if (linesToClearCount > 0) {
-    clearingLines    = true;
-    clearTimerFrames = LINE_CLEAR_DELAY_FRAMES;
-    blinkFrameCounter = 0;
-    blinkOn = false;
-    if (sfxLineClearReady) {
-      if (linesToClearCount == 4) PlaySound(sfxTetris);
-      else                        PlaySound(sfxLineClear);
-    }
-  } else {
-    ApplyScoring(0);
-    spawnDelayFrames = SPAWN_DELAY_FRAMES;
-  }
-}
-
-static void GenerateRandomPiece(void) {
-  cur.type = nextType;
-  cur.rot  = 0;
-  cur.x    = (COLS-2) / 2;
-  cur.y    = 0;
-  nextType = RandomType();
-  if (!CanPlace(cur.type, cur.rot, cur.x, cur.y)) {
-    itsOver     = true;
-    pieceActive = false;
-    goFlow      = GO_ASK_SAVE;
-    StopGameplayMusic();
-    if (sfxGameOverReady) PlaySound(sfxGameOver);
-    nameInput[0] = '\0';
-    nameLen      = 0;
-    return;
-  }
-  pieceActive = true;
-}
+/* ===================== DRAW HELPERS ===================== */
 
-static void TryMove(int dx, int dy) {
-  int nx = cur.x + dx;
-  int ny = cur.y + dy;
-  if (CanPlace(cur.type, cur.rot, nx, ny)) {
-    cur.x = nx;
-    cur.y = ny;
-  } else if (dy == 1) {
-    LockCurrentPiece();
-  }
+static BoardLayout GetBoardLayout(const GameState *g) {
+  float cell = (float)SQUARE_SIZE;
+  float fitW = (float)BOARD_AREA_W / (float)GameCols(g);
+  float fitH = (float)BOARD_AREA_H / (float)GameRows(g);
+  if (fitW < cell) cell = fitW;
+  if (fitH < cell) cell = fitH;
+  return (BoardLayout){ BOARD_X_AXIS, BOARD_Y_AXIS, cell };
 }
 
-static void TryRotateCW(void) {
-  int nr = (cur.rot+1) & 3;
-  if (CanPlace(cur.type, nr, cur.x, cur.y)) { cur.rot = nr; return; }
-  const int kicks[] = { -1, 1, -2, 2 };
-  for (int i = 0; i < 4; i++) {
-    if (CanPlace(cur.type, nr, cur.x + kicks[i], cur.y)) {
-      cur.x += kicks[i]; cur.rot = nr; return;
-    }
-  }
+static Rectangle CellRect(BoardLayout l, int x, int y) {
+  return (Rectangle){ l.x + x * l.cell, l.y + y * l.cell, l.cell, l.cell };
 }
 
-static void TryRotateCCW(void) {
-  int nr = (cur.rot+3) & 3;
-  if (CanPlace(cur.type, nr, cur.x, cur.y)) { cur.rot = nr; return; }
-  const int kicks[] = { -1, 1, -2, 2 };
-  for (int i = 0; i < 4; i++) {
-    if (CanPlace(cur.type, nr, cur.x + kicks[i], cur.y)) {
-      cur.x += kicks[i]; cur.rot = nr; return;
+/* Boards too dense for per-cell outlines: walls as three bars and each row
+   as runs of same-coloured cells. */
+static void GridGraphicCompact(const GameState *g, BoardLayout l, const Color placedColors[TETROMINO_COUNT], Color wallColor) {
+  int cols = GameCols(g), rows = GameRows(g);
+  DrawRectangleRec((Rectangle){ l.x, l.y, l.cell, rows * l.cell }, wallColor);
+  DrawRectangleRec((Rectangle){ l.x + (cols-1) * l.cell, l.y, l.cell, rows * l.cell }, wallColor);
+  DrawRectangleRec((Rectangle){ l.x, l.y + (rows-1) * l.cell, cols * l.cell, l.cell }, wallColor);
+  for (int y = 0; y < rows-1; y++) {
+    if (RowCellCount(g, y) == 0) continue;
+    bool blink = RowBlinking(g, y);
+    int x = 1;
+    while (x < cols-1) {
+      PiecesFormat t = CellPiece(g, x, y);
+      int start = x;
+      while (x < cols-1 && CellPiece(g, x, y) == t) x++;
+      if (t == TETROMINO_COUNT) continue;
+      Color fill = blink ? (Color){255,255,255,200} : placedColors[t];
+      DrawRectangleRec((Rectangle){ l.x + start * l.cell, l.y + y * l.cell, (x - start) * l.cell, l.cell }, fill);
     }
   }
 }
 
-static void HardDrop(void) {
-  int dropped = 0;
-  while (CanPlace(cur.type, cur.rot, cur.x, cur.y+1)) { cur.y++; dropped++; }
-  score += dropped * 2 * level;
-  LockCurrentPiece();
-}
-
-/* ===================== INPUT (HORIZONTAL) ===================== */
-
-static void HandleHorizontalInput(void) {
-  float frameTime = GetFrameTime();
-  bool left  = BindingDown(keys.moveLeft);
-  bool right = BindingDown(keys.moveRight);
-  if (left && right) { holdLeftTime = holdRightTime = 0.0f; return; }
-  if (left) {
-    if (holdLeftTime == 0.0f) TryMove(LEFT, 0);
-    holdLeftTime += frameTime;
-    if (holdLeftTime >= DAS)
-      while (holdLeftTime >= DAS + ARR) { TryMove(LEFT, 0); holdLeftTime -= ARR; }
-  } else { holdLeftTime = 0.0f; }
-  if (right) {
-    if (holdRightTime == 0.0f) TryMove(RIGHT, 0);
-    holdRightTime += frameTime;
-    if (holdRightTime >= DAS)
-      while (holdRightTime >= DAS + ARR) { TryMove(RIGHT, 0); holdRightTime -= ARR; }
-  } else { holdRightTime = 0.0f; }
-}
-
-/* ===================== GRID ===================== */
-
-static void GenerateGrid(void) {
-  for (int x = 0; x < COLS; x++)
-    for (int y = 0; y < ROWS; y++) {
-      if (x == 0 || x == COLS-1 || y == ROWS-1) grid[x][y] = BOARD_LIMIT;
-      else grid[x][y] = EMPTY;
-    }
-}
-
-/* ===================== DRAW HELPERS ===================== */
-
-static void GridGraphic(Color gridLine, Color placedColor, Color wallColor) {
-  for (int y = 0; y < ROWS; y++)
-    for (int x = 0; x < COLS; x++) {
-      int xPos = BOARD_X_AXIS + x * SQUARE_SIZE;
-      int yPos = BOARD_Y_AXIS + y * SQUARE_SIZE;
-      switch (grid[x][y]) {
+static void GridGraphic(const GameState *g, Color gridLine, const Color placedColors[TETROMINO_COUNT], Color wallColor) {
+  BoardLayout l = GetBoardLayout(g);
+  if (l.cell < DETAIL_MIN_CELL) { GridGraphicCompact(g, l, placedColors, wallColor); return; }
+  int cols = GameCols(g), rows = GameRows(g);
+  for (int y = 0; y < rows; y++)
+    for (int x = 0; x < cols; x++) {
+      Rectangle r = CellRect(l, x, y);
+      switch (CellAt(g, x, y)) {
         case EMPTY:
-          DrawRectangleLines(xPos, yPos, SQUARE_SIZE, SQUARE_SIZE, gridLine);
+          DrawRectangleLinesEx(r, 1, gridLine);
           break;
         case PLACED_PIECE: {
-          Color fill = placedColor;
-          if (clearingLines) {
-            for (int i = 0; i < linesToClearCount; i++)
-              if (linesToClear[i] == y) {
-                fill = blinkOn ? (Color){255,255,255,200} : placedColor;
-                break;
-              }
-          }
-          DrawRectangle(xPos, yPos, SQUARE_SIZE, SQUARE_SIZE, fill);
-          DrawRectangleLines(xPos, yPos, SQUARE_SIZE, SQUARE_SIZE, gridLine);
+          PiecesFormat t = CellPiece(g, x, y);
+          Color fill = (t < TETROMINO_COUNT) ? placedColors[t] : gridLine;
+          if (RowBlinking(g, y)) fill = (Color){255,255,255,200};
+          DrawRectangleRec(r, fill);
+          DrawRectangleLinesEx(r, 1, gridLine);
         } break;
         case BOARD_LIMIT:
-          DrawRectangle(xPos, yPos, SQUARE_SIZE, SQUARE_SIZE, wallColor);
+          DrawRectangleRec(r, wallColor);
           break;
         default: break;
       }
     }
 }
 
-static void DrawActivePiece(Color activeColor) {
-  if (!pieceActive) return;
+static void DrawActivePiece(const GameState *g, const Color pieceColors[TETROMINO_COUNT]) {
+  ActivePiece cur;
+  if (!GameCurrentPiece(g, &cur)) return;
+  int cells[4][2];
+  PieceCells(cur.type, cur.rot, cells);
+  BoardLayout l = GetBoardLayout(g);
   for (int i = 0; i < 4; i++) {
-    int gx = cur.x + SHAPES[cur.type][cur.rot][i][0];
-    int gy = cur.y + SHAPES[cur.type][cur.rot][i][1];
+    int gx = cur.x + cells[i][0];
+    int gy = cur.y + cells[i][1];
     if (gy < 0) continue;
-    DrawRectangle(BOARD_X_AXIS + gx * SQUARE_SIZE,
-                  BOARD_Y_AXIS + gy * SQUARE_SIZE,
-                  SQUARE_SIZE, SQUARE_SIZE, activeColor);
+    DrawRectangleRec(CellRect(l, gx, gy), pieceColors[cur.type]);
+  }
+}
+
+static void DrawGhostPiece(const GameState *g, Color ghostColor) {
+  ActivePiece cur;
+  if (!GameCurrentPiece(g, &cur)) return;
+  int ghostY = cur.y + GameDropDistance(g);
+  if (ghostY == cur.y) return;
+  int cells[4][2];
+  PieceCells(cur.type, cur.rot, cells);
+  BoardLayout l = GetBoardLayout(g);
+  for (int i = 0; i < 4; i++) {
+    int gx = cur.x + cells[i][0];
+    int gy = ghostY + cells[i][1];
+    if (gy < 0) continue;
+    DrawRectangleLinesEx(CellRect(l, gx, gy), 1, ghostColor);
   }
 }
 
 static void DrawPiecePreview(PiecesFormat t, int px, int py, int cell, Color fill) {
+  int cells[4][2];
+  PieceCells(t, 0, cells);
   int minX = 999, minY = 999;
   for (int i = 0; i < 4; i++) {
-    if (SHAPES[t][0][i][0] < minX) minX = SHAPES[t][0][i][0];
-    if (SHAPES[t][0][i][1] < minY) minY = SHAPES[t][0][i][1];
+    if (cells[i][0] < minX) minX = cells[i][0];
+    if (cells[i][1] < minY) minY = cells[i][1];
   }
   for (int i = 0; i < 4; i++) {
-    int dx = SHAPES[t][0][i][0] - minX;
-    int dy = SHAPES[t][0][i][1] - minY;
+    int dx = cells[i][0] - minX;
+    int dy = cells[i][1] - minY;
     DrawRectangle(px + dx*cell, py + dy*cell, cell, cell, fill);
   }
 }
 
-/* ===================== GAMEPLAY UPDATE ===================== */
-
-static void UpdateGameplay(void) {
-  if (itsOver) return;
-  if (gamePaused){
-    return;
-  }
-  
-  if (clearingLines) {
-    blinkFrameCounter++;
-    if (blinkFrameCounter >= LINE_CLEAR_BLINK_EVERY) {
-      blinkFrameCounter = 0;
-      blinkOn = !blinkOn;
-    }
-    clearTimerFrames--;
-    if (clearTimerFrames <= 0) {
-      ApplyLineClearNow(linesToClear, linesToClearCount);
-      ApplyScoring(linesToClearCount);
-      clearingLines    = false;
-      linesToClearCount = 0;
-      spawnDelayFrames  = SPAWN_DELAY_FRAMES;
-    }
-    return;
-  }
-
-  if (!pieceActive) {
-    if (spawnDelayFrames > 0) { spawnDelayFrames--; return; }
-    GenerateRandomPiece();
+/* Board, pieces and HUD of a game being played or watched. */
+static void DrawGameScene(const GameState *g, Color gridLine, const Color placedColors[TETROMINO_COUNT],
+                          Color wallColor, Color ghostColor, Color hudText) {
+  GridGraphic(g, gridLine, placedColors, wallColor);
+  DrawGhostPiece(g, ghostColor);
+  DrawActivePiece(g, PIECE_COLORS);
+
+  DrawText(TextFormat("Score: %d", GameScore(g)), 380, 100, 20, hudText);
+  DrawText(TextFormat("Lines: %d", GameLines(g)), 380, 130, 20, hudText);
+  DrawText(TextFormat("Level: %d", GameLevel(g)), 380, 160, 20, hudText);
+  DrawText("Next:", 380, 210, 20, hudText);
+  for (int i = 0; i < GamePreviewCount(g); i++) {
+    PiecesFormat t = QueuePeek(g, i);
+    DrawPiecePreview(t, 380, 240 + i*48, 18, PIECE_COLORS[t]);
   }
-  if (itsOver) return;
+}
 
-  if (pieceActive) {
-    HandleHorizontalInput();
+/* ===================== GAMEPLAY UPDATE ===================== */
 
-    if (BindingPressed(keys.rotateCW))  TryRotateCW();
-    if (BindingPressed(keys.rotateCCW)) TryRotateCCW();
-    if (BindingPressed(keys.hardDrop))  { HardDrop(); return; }
+/* Any value will do: the engine spreads it over its generator state. */
+static uint64_t NewGameSeed(void) {
+  static uint64_t gamesStarted = 0;
+  return (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32) ^ ++gamesStarted;
+}
 
-    float dt = GetFrameTime();
-    if (!BindingDown(keys.softDrop)) { downBlocked = false; holdDownTime = 0.0f; }
+/* Ends the running game's replay at the current tick. */
+static void StopRecording(void) {
+  if (!recorder) return;
+  ReplayRecordFinish(recorder, game);
+  recorder = NULL;
+}
 
-    if (BindingDown(keys.softDrop) && !downBlocked) {
-      if (holdDownTime == 0.0f) {
-        int oldY = cur.y;
-        TryMove(0, 1);
-        if (cur.y > oldY) score += 1 * level;
-      }
-      holdDownTime += dt;
-      if (holdDownTime >= SD_DAS)
-        while (holdDownTime >= SD_DAS + SD_ARR) {
-          int oldY = cur.y;
-          TryMove(0, 1);
-          if (cur.y > oldY) score += 1 * level;
-          holdDownTime -= SD_ARR;
-        }
-    }
+/* Never overwrites a replay: a name already taken gets a -2, -3... suffix. */
+static void StartRecording(uint64_t seed) {
+  char stamp[32], path[64];
+  time_t now = time(NULL);
+  strftime(stamp, sizeof stamp, REPLAY_FILE_NAME, localtime(&now));
+  snprintf(path, sizeof path, "%s" REPLAY_FILE_EXT, stamp);
+  for (int n = 2; FileExists(path); n++) {
+    if (n > REPLAY_NAME_TRIES) return;
+    snprintf(path, sizeof path, "%s-%d" REPLAY_FILE_EXT, stamp, n);
   }
-
-  frameCounter += scrollSpeed;
-  if (frameCounter >= 60) { frameCounter = 0; TryMove(0, 1); }
+  ReplayHeader header = { seed, rulesetIndex, startLevel, GameCols(game), GameRows(game), GamePreviewCount(game),
+                          handling.das, handling.arr, handling.sdArr };
+  recorder = ReplayRecordStart(path, &header);
+  if (recorder) strcpy(lastReplayPath, path);
 }
 
 static void RestartGame(void) {
-  itsOver      = false;
-  gamePaused = false;
+  StopRecording();
+  uint64_t seed = NewGameSeed();
+  GameSetPreviews(game, previewCount);
+  GameSetHandling(game, handling.das, handling.arr, handling.sdArr);
+  GameInit(game, seed, rulesetIndex, startLevel);
+  if (recordReplays) StartRecording(seed);
+  gamePaused    = false;
   pauseCooldown = 0.0f;
-  pieceActive  = false;
-  frameCounter = 0;
-  spawnDelayFrames = 0;
-
-  holdLeftTime  = 0.0f;
-  holdRightTime = 0.0f;
-  holdDownTime  = 0.0f;
-  downBlocked   = false;
-
-  clearingLines    = false;
-  clearTimerFrames = 0;
-  linesToClearCount = 0;
-  blinkFrameCounter = 0;
-  blinkOn = false;
-
-  score        = 0;
-  linesCleared = (startLevel - 1) * 10;
-  level        = startLevel;
-
-  if (level < 10) scrollSpeed = 1 + (level - 1);
-  else if (level <= 12) scrollSpeed = 12;
-  else if (level <= 15) scrollSpeed = 15;
-  else if (level <= 18) scrollSpeed = 20;
-  else if (level <= 28) scrollSpeed = 30;
-  else                  scrollSpeed = 60;
-
-  combo      = -1;
-  backToBack = false;
+  simAccumulator = 0.0;
+  simPresses     = 0;
 
   goFlow       = GO_SHOW_GAMEOVER;
   nameInput[0] = '\0';
   nameLen      = 0;
+}
 
-  GenerateGrid();
-  nextType = RandomType();
+/* Reuses the current game when the size matches. False if no game could be
+   allocated; a failed resize keeps the previous board. */
+static bool StartNewGame(int cols, int rows) {
+  if (!game || GameCols(game) != cols || GameRows(game) != rows) {
+    GameState *g = GameCreate(cols, rows);
+    if (g) { GameDestroy(game); game = g; }
+  }
+  if (!game) return false;
+  RestartGame();
+  return true;
+}
+
+/* Runs as many fixed ticks as real time dt covers, whatever the frame rate,
+   and returns the GameEvent bits they raised. After a long stall the
+   backlog is dropped instead of fast-forwarded. */
+static unsigned RunSimulation(float dt) {
+  const double tick = 1.0 / SIM_TICK_RATE;
+  unsigned held = ReadGameInput(BindingDown);
+  simPresses |= ReadGameInput(BindingPressed);
+  simAccumulator += dt;
+  unsigned events = 0;
+  int ticks = 0;
+  while (simAccumulator >= tick) {
+    if (ticks == MAX_CATCHUP_TICKS) { simAccumulator = 0.0; break; }
+    if (recorder) ReplayRecordTick(recorder, held | simPresses);
+    GameStep(game, held | simPresses);
+    events |= GameEvents(game);
+    simPresses = 0;
+    simAccumulator -= tick;
+    ticks++;
+  }
+  return events;
 }
 
 /* ===================== GAME OVER OVERLAY ===================== */
 
+static void OnGameOver(void) {
+  StopRecording();
+  goFlow = GO_ASK_SAVE;
+  StopGameplayMusic();
+  if (sfxGameOverReady) PlaySound(sfxGameOver);
+  nameInput[0] = '\0';
+  nameLen      = 0;
+}
+
 static void UpdateGameOverOverlay(Rectangle panel, Rectangle yesBtn, Rectangle noBtn, Rectangle inputBox, Vector2 m) {
   if (goFlow == GO_ASK_SAVE) {
     if (CheckCollisionPointRec(m, yesBtn) && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
@@ -948,7 +811,7 @@ static void UpdateGameOverOverlay(Rectangle panel, Rectangle yesBtn, Rectangle n
     if (IsKeyPressed(KEY_BACKSPACE) && nameLen > 0)
       nameInput[--nameLen] = '\0';
     if (IsKeyPressed(KEY_ENTER)) {
-      AddScoreToLeaderboard(nameLen == 0 ? "PLAYER" : nameInput, score);
+      AddScoreToLeaderboard(nameLen == 0 ? "PLAYER" : nameInput, GameScore(game));
       goFlow = GO_SHOW_GAMEOVER;
     }
     (void)panel; (void)inputBox;
@@ -964,7 +827,7 @@ static void DrawGameOverOverlay(int screenWidth, int screenHeight, Color hudText
   if (goFlow == GO_ASK_SAVE) {
     const char *q = "Save score?";
     DrawText(q, cx - MeasureText(q, 34)/2, (int)panel.y + 25, 34, hudText);
-    DrawText(TextFormat("Score: %d", score), (int)panel.x + 30, (int)panel.y + 80, 22, hudText);
+    DrawText(TextFormat("Score: %d", GameScore(game)), (int)panel.x + 30, (int)panel.y + 80, 22, hudText);
 
     Rectangle yesBtn = { panel.x + 110,                    panel.y + 150, 110, 40 };
     Rectangle noBtn  = { panel.x + panel.width - 220,      panel.y + 150, 110, 40 };
@@ -982,7 +845,7 @@ static void DrawGameOverOverlay(int screenWidth, int screenHeight, Color hudText
   } else if (goFlow == GO_ENTER_NAME) {
     const char *t = "Type your name:";
     DrawText(t, cx - MeasureText(t, 28)/2, (int)panel.y + 25, 28, hudText);
-    DrawText(TextFormat("Score: %d", score), (int)panel.x + 30, (int)panel.y + 70, 22, hudText);
+    DrawText(TextFormat("Score: %d", GameScore(game)), (int)panel.x + 30, (int)panel.y + 70, 22, hudText);
 
     Rectangle inputBox = { panel.x + 80, panel.y + 120, panel.width - 160, 45 };
     Vector2 m = mousePoint;
@@ -1017,6 +880,82 @@ static void UpdateScoresScreen(Rectangle backBtn, Rectangle prevBtn, Rectangle n
   (void)backBtn;
 }
 
+/* ===================== REPLAY VIEWER ===================== */
+
+static void CloseReplayViewer(void) {
+  ReplayPlayerClose(viewer);
+  viewer = NULL;
+}
+
+static bool OpenReplayViewer(const char *path) {
+  ReplayPlayer *p = ReplayPlayerOpen(path);
+  if (!p) return false;
+  CloseReplayViewer();
+  viewer            = p;
+  viewerSpeed       = 1.0f;
+  viewerPaused      = false;
+  viewerScrubbing   = false;
+  viewerAccumulator = 0.0;
+  return true;
+}
+
+static uint32_t SkipTicks(uint32_t tick, int delta) {
+  if (delta < 0 && tick < (uint32_t)-delta) return 0;
+  return tick + (uint32_t)delta;
+}
+
+/* Space or Pause: pause; Up/Down: double or halve the speed; Left/Right:
+   skip; the timeline bar: drag to any tick. Playback runs speed times as
+   many ticks as real time covers, so 64x is about 3840 ticks a second. */
+static unsigned UpdateReplayViewer(Rectangle timeline, Vector2 m) {
+  if (IsKeyPressed(KEY_SPACE) || BindingPressed(keys.pause)) viewerPaused = !viewerPaused;
+  if (IsKeyPressed(KEY_UP)   && viewerSpeed < REPLAY_MAX_SPEED) viewerSpeed *= 2.0f;
+  if (IsKeyPressed(KEY_DOWN) && viewerSpeed > REPLAY_MIN_SPEED) viewerSpeed *= 0.5f;
+  if (IsKeyPressed(KEY_LEFT))  ReplayPlayerSeek(viewer, SkipTicks(ReplayPlayerTick(viewer), -REPLAY_SKIP_TICKS));
+  if (IsKeyPressed(KEY_RIGHT)) ReplayPlayerSeek(viewer, SkipTicks(ReplayPlayerTick(viewer),  REPLAY_SKIP_TICKS));
+
+  if (CheckCollisionPointRec(m, timeline) && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) viewerScrubbing = true;
+  if (!IsMouseButtonDown(MOUSE_BUTTON_LEFT)) viewerScrubbing = false;
+  if (viewerScrubbing) {
+    float t = (m.x - timeline.x) / timeline.width;
+    if (t < 0.0f) t = 0.0f;
+    if (t > 1.0f) t = 1.0f;
+    ReplayPlayerSeek(viewer, (uint32_t)(t * (float)ReplayPlayerLength(viewer) + 0.5f));
+    viewerAccumulator = 0.0;
+    return 0;
+  }
+
+  if (viewerPaused) return 0;
+  viewerAccumulator += GetFrameTime() * viewerSpeed * SIM_TICK_RATE;
+  uint32_t ticks = (uint32_t)viewerAccumulator;
+  viewerAccumulator -= ticks;
+  return ReplayPlayerAdvance(viewer, ticks);
+}
+
+static const char *TickClock(uint32_t tick) {
+  uint32_t seconds = tick / SIM_TICK_RATE;
+  return TextFormat("%02u:%02u", seconds / 60, seconds % 60);
+}
+
+static void DrawReplayViewer(Rectangle timeline, Color hudText, Color highlight) {
+  uint32_t tick = ReplayPlayerTick(viewer), length = ReplayPlayerLength(viewer);
+  const ReplayHeader *h = ReplayPlayerHeader(viewer);
+  DrawText(TextFormat("REPLAY  %s rules", RulesetName(h->ruleset)), 380, 40, 20, highlight);
+  DrawText("Space pause  Up/Down speed  Left/Right skip", 380, 66, 14, hudText);
+
+  const char *state = tick >= length ? "END" : viewerPaused ? "PAUSED" : "";
+  char now[16];
+  strcpy(now, TickClock(tick));
+  DrawText(TextFormat("%s / %s   x%g   %s", now, TickClock(length), viewerSpeed, state),
+           (int)timeline.x, (int)timeline.y - 26, 18, hudText);
+  if (!ReplayPlayerVerified(viewer))
+    DrawText("unverified", (int)(timeline.x + timeline.width) - MeasureText("unverified", 14), (int)timeline.y - 22, 14, hudText);
+
+  float done = length > 0 ? (float)tick / (float)length : 1.0f;
+  DrawRectangleLinesEx(timeline, 2, hudText);
+  DrawRectangleRec((Rectangle){ timeline.x, timeline.y, timeline.width * done, timeline.height }, highlight);
+}
+
 /* ===================== MAIN ===================== */
 
 int main(void) {
@@ -1048,11 +987,11 @@ int main(void) {
   SetExitKey(0);
   SetTargetFPS(60);
   InitGameAudio();
-  SetRandomSeed((unsigned int)time(NULL));
-  nextType = RandomType();
+  EngineInit();
 
   LoadLeaderboardFromFile();
   LoadKeybinds();
+  LoadHandling();
 
   /* init hover arrays */
   for (int i = 0; i < PAGE_SIZE;    i++) prevHoverClear[i]  = false;
@@ -1088,8 +1027,9 @@ int main(void) {
     Color gameBg      = Mix(bgColor, BLACK, 0.75f);
     Color gridLine    = Mix(textBase, gameBg, 0.60f);
     Color wallColor   = Mix(textBase, gameBg, 0.30f);
-    Color activeColor = highlight;
-    Color placedColor = Mix(highlight, gameBg, 0.55f);
+    Color placedColors[TETROMINO_COUNT];
+    for (int t = 0; t < TETROMINO_COUNT; t++) placedColors[t] = Mix(PIECE_COLORS[t], gameBg, 0.35f);
+    Color ghostColor  = Mix(highlight, gameBg, 0.35f);
     Color hudText     = Mix(textBase, RAYWHITE, 0.65f);
 
     float scaleX = (float)GetRenderWidth()  / (float)screenWidth;
@@ -1119,9 +1059,28 @@ int main(void) {
     int themeW = MeasureText(themeLabel, 20);
     Rectangle themeButton = { (float)(centerPlay + 25), 550, (float)themeW, 20 };
 
+    const char *replaysLabel = TextFormat("Replays: %s", recordReplays ? "On" : "Off");
+    int replaysW = MeasureText(replaysLabel, 20);
+    Rectangle replaysButton = { (float)(centerPlay + 25), 575, (float)replaysW, 20 };
+    int watchW = MeasureText("Watch Last", 20);
+    Rectangle watchButton = { replaysButton.x + replaysW + 30, 575, (float)watchW, 20 };
+    Rectangle timeline = { 380, 565, 380, 14 };
+
     const char *lvlLabel = TextFormat("Start Level: [ %d ]", startLevel);
     int lvlW = MeasureText(lvlLabel, 28);
-    Rectangle levelButton = { (float)(screenWidth/2 - lvlW/2), 420, (float)lvlW, 28 };
+    Rectangle levelButton = { (float)(screenWidth/2 - lvlW/2), 410, (float)lvlW, 28 };
+
+    const char *boardLabel = TextFormat("Board: [ %d x %d ]", BOARD_SIZES[boardSizeIndex].width, BOARD_SIZES[boardSizeIndex].height);
+    int boardW = MeasureText(boardLabel, 28);
+    Rectangle boardButton = { (float)(screenWidth/2 - boardW/2), 445, (float)boardW, 28 };
+
+    const char *previewLabel = TextFormat("Previews: [ %d ]", previewCount);
+    int previewW = MeasureText(previewLabel, 28);
+    Rectangle previewButton = { (float)(screenWidth/2 - previewW/2), 480, (float)previewW, 28 };
+
+    const char *rulesLabel = TextFormat("Rules: [ %s ]", RulesetName(rulesetIndex));
+    int rulesW = MeasureText(rulesLabel, 28);
+    Rectangle rulesButton = { (float)(screenWidth/2 - rulesW/2), 515, (float)rulesW, 28 };
 
     /* ---- UPDATE SWITCH ---- */
     switch (currentScreen) {
@@ -1131,45 +1090,26 @@ int main(void) {
         bool hScores   = CheckCollisionPointRec(mousePoint, scoresButton);
         bool hSettings = CheckCollisionPointRec(mousePoint, settingsButton);
         bool hLevel = CheckCollisionPointRec(mousePoint, levelButton);
+        bool hBoard = CheckCollisionPointRec(mousePoint, boardButton);
+        bool hPreview = CheckCollisionPointRec(mousePoint, previewButton);
+        bool hRules = CheckCollisionPointRec(mousePoint, rulesButton);
         if (hPlay     && !prevHoverPlay)      PlayTick();
         if (hScores   && !prevHoverScoresBtn) PlayTick();
         if (hSettings && !prevHoverSettings)  PlayTick();
         if (hLevel    && !prevHoverLevel)     PlayTick();
+        if (hBoard    && !prevHoverBoard)     PlayTick();
+        if (hPreview  && !prevHoverPreview)   PlayTick();
+        if (hRules    && !prevHoverRules)     PlayTick();
         prevHoverPlay      = hPlay;
         prevHoverScoresBtn = hScores;
         prevHoverSettings  = hSettings;
         prevHoverLevel     = hLevel;
+        prevHoverBoard     = hBoard;
+        prevHoverPreview   = hPreview;
+        prevHoverRules     = hRules;
 
         if (hPlay && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
-          GenerateGrid();
-          itsOver = false;
-          pieceActive = false;
-          frameCounter = 0;
-          holdLeftTime = holdRightTime = holdDownTime = 0.0f;
-          downBlocked = false;
-          spawnDelayFrames = 0;
-          clearingLines = false;
-          clearTimerFrames = 0;
-          linesToClearCount = 0;
-          blinkFrameCounter = 0;
-          blinkOn = false;
-          score = 0;
-          level = startLevel;
-          linesCleared = (startLevel - 1) * 10;
-          
-          if (level < 10) scrollSpeed = 1 + (level - 1);
-          else if (level <= 12) scrollSpeed = 12;
-          else if (level <= 15) scrollSpeed = 15;
-          else if (level <= 18) scrollSpeed = 20;
-          else if (level <= 28) scrollSpeed = 30;
-          else                  scrollSpeed = 60;
-          
-          combo = -1;
-          backToBack = false;
-          goFlow = GO_SHOW_GAMEOVER;
-          nameInput[0] = '\0';
-          nameLen = 0;
-          nextType = RandomType();
+          if (!StartNewGame(BOARD_SIZES[boardSizeIndex].width + 2, BOARD_SIZES[boardSizeIndex].height + 1)) break;
           menuMusicDelay = 0.0f;
           StopMusicStream(musicMenu);
           currentScreen = GAMEPLAY;
@@ -1184,6 +1124,16 @@ int main(void) {
         }
         if (CheckCollisionPointRec(mousePoint, themeButton) && IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
           currentTheme = (ThemeOptions)((currentTheme+1) % THEME_COUNT);
+        if (CheckCollisionPointRec(mousePoint, replaysButton) && IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
+          recordReplays = !recordReplays;
+        if (lastReplayPath[0] && CheckCollisionPointRec(mousePoint, watchButton) && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)
+            && OpenReplayViewer(lastReplayPath))
+          currentScreen = REPLAY;
+        if (IsFileDropped()) {
+          FilePathList dropped = LoadDroppedFiles();
+          if (dropped.count > 0 && OpenReplayViewer(dropped.paths[0])) currentScreen = REPLAY;
+          UnloadDroppedFiles(dropped);
+        }
         
         if (hLevel) {
           if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
@@ -1195,6 +1145,31 @@ int main(void) {
             if (startLevel < MIN_START_LEVEL) startLevel = MAX_START_LEVEL;  /* wrap */
           }
         }
+
+        if (hBoard) {
+          if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
+            boardSizeIndex = (boardSizeIndex + 1) % BOARD_SIZE_COUNT;
+          if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT))
+            boardSizeIndex = (boardSizeIndex + BOARD_SIZE_COUNT - 1) % BOARD_SIZE_COUNT;
+        }
+
+        if (hPreview) {
+          if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+            previewCount++;
+            if (previewCount > MAX_PREVIEWS) previewCount = MIN_PREVIEWS;  /* wrap */
+          }
+          if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT)) {
+            previewCount--;
+            if (previewCount < MIN_PREVIEWS) previewCount = MAX_PREVIEWS;  /* wrap */
+          }
+        }
+
+        if (hRules) {
+          if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
+            rulesetIndex = (RulesetId)((rulesetIndex + 1) % RULESET_COUNT);
+          if (IsMouseButtonPressed(MOUSE_BUTTON_RIGHT))
+            rulesetIndex = (RulesetId)((rulesetIndex + RULESET_COUNT - 1) % RULESET_COUNT);
+        }
         
       } break;
 
@@ -1204,6 +1179,7 @@ int main(void) {
         prevHoverBack = hBack;
 
         if (hBack && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+          StopRecording();
           StopGameplayMusic();
           StopMusicStream(musicMenu);
           SeekMusicStream(musicMenu, 0.0f);
@@ -1212,7 +1188,7 @@ int main(void) {
           break;
         }
         
-        if(BindingPressed(keys.pause)&& !itsOver){
+        if(BindingPressed(keys.pause)&& !GameIsOver(game)){
           
           if(pauseCooldown <= 0.0f) {
             gamePaused = !gamePaused;
@@ -1232,10 +1208,12 @@ int main(void) {
           }     
         }
 
-        UpdateGameplay();
-        UpdateGameplayMusic();
+        unsigned events = gamePaused ? 0 : RunSimulation(GetFrameTime());
+        PlayEventSounds(events);
+        if (events & EVENT_GAME_OVER) OnGameOver();
+        UpdateGameplayMusic(game);
 
-        if (itsOver && goFlow == GO_ASK_SAVE) {
+        if (GameIsOver(game) && goFlow == GO_ASK_SAVE) {
           Rectangle panel  = { 160, 170, 480, 230 };
           Rectangle yesBtn = { panel.x + 110,               panel.y + 150, 110, 40 };
           Rectangle noBtn  = { panel.x + panel.width - 220, panel.y + 150, 110, 40 };
@@ -1245,7 +1223,7 @@ int main(void) {
           if (hNo  && !prevHoverNo)  PlayTick();
           prevHoverYes = hYes;
           prevHoverNo  = hNo;
-        } else if (itsOver && goFlow == GO_ENTER_NAME) {
+        } else if (GameIsOver(game) && goFlow == GO_ENTER_NAME) {
           Rectangle panel    = { 160, 170, 480, 230 };
           Rectangle inputBox = { panel.x + 80, panel.y + 120, panel.width - 160, 45 };
           bool hInp = CheckCollisionPointRec(mousePoint, inputBox);
@@ -1253,12 +1231,27 @@ int main(void) {
           prevHoverInput = hInp;
         }
 
-        if (itsOver && goFlow == GO_SHOW_GAMEOVER && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+        if (GameIsOver(game) && goFlow == GO_SHOW_GAMEOVER && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
           RestartGame();
           StartGameplayMusic();
         }
       } break;
 
+      case REPLAY: {
+        bool hBack = CheckCollisionPointRec(mousePoint, backBtn);
+        if (hBack && !prevHoverBack) PlayTick();
+        prevHoverBack = hBack;
+
+        if (hBack && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
+          CloseReplayViewer();
+          currentScreen = MAINSCREEN;
+          break;
+        }
+
+        unsigned events = UpdateReplayViewer(timeline, mousePoint);
+        if (viewerSpeed <= 1.0f) PlayEventSounds(events);
+      } break;
+
       case SCORES: {
         bool hBack = CheckCollisionPointRec(mousePoint, backBtn);
         if (hBack && !prevHoverBack) PlayTick();
@@ -1306,6 +1299,7 @@ int main(void) {
         if (hBack && IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) {
           settingsFlow = SF_IDLE; rebindingIndex = -1; rebindingGP = false;
           SaveKeybinds();
+          SaveHandling();
           currentScreen = MAINSCREEN;
           break;
         }
@@ -1361,6 +1355,19 @@ int main(void) {
             if (hGp && IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
               { settingsFlow = SF_WAITING_GP; rebindingIndex = i; rebindingGP = true; }
           }
+          /* handling: left click raises, right click lowers */
+          for (int i = 0; i < HANDLING_COUNT; i++) {
+            int *v = HandlingByIndex(i);
+            const char *label = TextFormat("%s: [ %d ]", handlingLabels[i], *v);
+            Rectangle btn = { (float)HANDLING_X[i], 80, (float)MeasureText(label, 20), 20 };
+            bool h = CheckCollisionPointRec(mousePoint, btn);
+            if (h && !prevHoverHandling[i]) PlayTick();
+            prevHoverHandling[i] = h;
+            if (h && IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
+              *v = *v >= MAX_HANDLING_SETTING ? 0 : *v + 1;  /* wrap */
+            if (h && IsMouseButtonPressed(MOUSE_BUTTON_RIGHT))
+              *v = *v <= 0 ? MAX_HANDLING_SETTING : *v - 1;  /* wrap */
+          }
           /* reset button */
           Rectangle resetBtn = { 280, 550, 240, 36 };
           bool hReset = CheckCollisionPointRec(mousePoint, resetBtn);
@@ -1373,6 +1380,7 @@ int main(void) {
               { KEY_UP,    -1 }, { KEY_X,     -1 },
 	      { KEY_P,    -1 },
             };
+            handling = (Handling){ DEFAULT_DAS_TICKS, DEFAULT_ARR_TICKS, DEFAULT_SD_ARR_TICKS };
             settingsFlow = SF_IDLE;
           }
         }
@@ -1389,7 +1397,7 @@ int main(void) {
       pauseCooldown -= GetFrameTime(); //pause cooldown
     }
     
-    if (currentScreen == MAINSCREEN || currentScreen == SCORES || currentScreen == SETTINGS)
+    if (currentScreen == MAINSCREEN || currentScreen == SCORES || currentScreen == SETTINGS || currentScreen == REPLAY)
       UpdateMusicStream(musicMenu);
 
 
@@ -1407,26 +1415,30 @@ int main(void) {
         Color cScores   = CheckCollisionPointRec(mousePoint, scoresButton)   ? highlight : textBase;
         Color cSettings = CheckCollisionPointRec(mousePoint, settingsButton) ? highlight : textBase;
         Color cLevel = CheckCollisionPointRec(mousePoint, levelButton) ? highlight : textBase;
+        Color cBoard = CheckCollisionPointRec(mousePoint, boardButton) ? highlight : textBase;
+        Color cPreview = CheckCollisionPointRec(mousePoint, previewButton) ? highlight : textBase;
+        Color cRules = CheckCollisionPointRec(mousePoint, rulesButton) ? highlight : textBase;
 
         DrawText("Play Game", centerPlay,     240, 40, cPlay);
         DrawText("Scores",    centerScores,   300, 40, cScores);
         DrawText("Settings",  centerSettings, 360, 40, cSettings);
         DrawText(themeLabel,  centerPlay + 25, 550, 20, textBase);
-        DrawText(lvlLabel, screenWidth/2 - lvlW/2, 420, 28, cLevel);
+        DrawText(replaysLabel, centerPlay + 25, 575, 20, textBase);
+        if (lastReplayPath[0]) {
+          Color cWatch = CheckCollisionPointRec(mousePoint, watchButton) ? highlight : textBase;
+          DrawText("Watch Last", (int)watchButton.x, 575, 20, cWatch);
+        }
+        DrawText(lvlLabel, screenWidth/2 - lvlW/2, 410, 28, cLevel);
+        DrawText(boardLabel, screenWidth/2 - boardW/2, 445, 28, cBoard);
+        DrawText(previewLabel, screenWidth/2 - previewW/2, 480, 28, cPreview);
+        DrawText(rulesLabel, screenWidth/2 - rulesW/2, 515, 28, cRules);
       } break;
 
       case GAMEPLAY: {
         ClearBackground(gameBg);
         DrawText("BACK", 20, 20, 20, hudText);
 
-        GridGraphic(gridLine, placedColor, wallColor);
-        DrawActivePiece(activeColor);
-	
-        DrawText(TextFormat("Score: %d", score),        380, 100, 20, hudText);
-        DrawText(TextFormat("Lines: %d", linesCleared), 380, 130, 20, hudText);
-        DrawText(TextFormat("Level: %d", level),        380, 160, 20, hudText);
-        DrawText("Next:", 380, 210, 20, hudText);
-        DrawPiecePreview(nextType, 380, 240, 18, activeColor);
+        DrawGameScene(game, gridLine, placedColors, wallColor, ghostColor, hudText);
 
 	if (gamePaused) {
 	  DrawRectangle(0, 0, screenWidth, screenHeight, (Color){0, 0, 0, 255});
@@ -1438,7 +1450,7 @@ int main(void) {
 	  DrawText(ph, screenWidth/2 - phw/2, screenHeight/2 + 10, 20, hudText);
 	}
 
-        if (itsOver) {
+        if (GameIsOver(game)) {
           if (goFlow != GO_SHOW_GAMEOVER) {
             DrawGameOverOverlay(screenWidth, screenHeight, hudText, highlight, mousePoint);
           } else {
@@ -1453,6 +1465,13 @@ int main(void) {
         }
       } break;
 
+      case REPLAY: {
+        ClearBackground(gameBg);
+        DrawText("BACK", 20, 20, 20, hudText);
+        DrawGameScene(ReplayPlayerGame(viewer), gridLine, placedColors, wallColor, ghostColor, hudText);
+        DrawReplayViewer(timeline, hudText, highlight);
+      } break;
+
       case SCORES: {
         ClearBackground(bgColor);
         DrawText("BACK",        20,  20, 20, textBase);
@@ -1506,6 +1525,12 @@ int main(void) {
         DrawText("KEYBOARD", 390, 118, 18, textBase);
         DrawText("GAMEPAD",  530, 118, 18, textBase);
 
+        for (int i = 0; i < HANDLING_COUNT; i++) {
+          const char *label = TextFormat("%s: [ %d ]", handlingLabels[i], *HandlingByIndex(i));
+          Rectangle btn = { (float)HANDLING_X[i], 80, (float)MeasureText(label, 20), 20 };
+          DrawText(label, HANDLING_X[i], 80, 20, CheckCollisionPointRec(mousePoint, btn) ? highlight : textBase);
+        }
+
         int gid = GetActiveGamepadId();
         bool gpConnected = (gid >= 0);
 
@@ -1574,6 +1599,10 @@ int main(void) {
   }
 
   SaveKeybinds();
+  SaveHandling();
+  StopRecording();
+  CloseReplayViewer();
+  GameDestroy(game);
   UnloadGameAudio();
   UnloadRenderTexture(target);
   CloseWindow();
@@ -0,0 +1,93 @@
+/* Programmed by edutavr */
+
+/* Reference bot for the batch runner's line protocol (see BOT PROCESS in
+   batch.c): drops each piece where its highest cell ends up lowest, with
+   the fewest new holes. Deliberately simple; it stands in for a real bot
+   in local runs:
+
+   ./build.sh batch -x ./rayblocks_refbot */
+
+#include "engine.h"
+#include <stdio.h>
+#include <string.h>
+
+#define LINE_MAX_BYTES (MAX_BOARD_COLS * MAX_BOARD_ROWS + 1024)
+
+static char line[LINE_MAX_BYTES];
+static int  width, height;
+static int  colHeight[MAX_BOARD_COLS];
+
+static int PieceFromLetter(char c) {
+  const char *p = strchr("IOTSZJL", c);
+  return p && c ? (int)(p - "IOTSZJL") : -1;
+}
+
+/* Column heights from the board token: rows from the top joined by '/'. */
+static void ReadBoard(const char *board) {
+  for (int x = 0; x < width; x++) colHeight[x] = 0;
+  for (int y = 0; y < height && *board; y++) {
+    for (int x = 0; x < width && *board && *board != '/'; x++, board++)
+      if (*board == '#' && colHeight[x] == 0) colHeight[x] = height - y;
+    while (*board && *board != '/') board++;
+    if (*board == '/') board++;
+  }
+}
+
+/* Best (rot, x) for piece t on the current column heights. */
+static void Choose(int t, int *bestRot, int *bestX) {
+  int bestTop = 1 << 30, bestHoles = 1 << 30;
+  *bestRot = 0;
+  *bestX   = 0;
+  for (int rot = 0; rot < 4; rot++) {
+    int cells[4][2], lo = 4, hi = -4;
+    PieceCells((PiecesFormat)t, rot, cells);
+    for (int i = 0; i < 4; i++) {
+      if (cells[i][0] < lo) lo = cells[i][0];
+      if (cells[i][0] > hi) hi = cells[i][0];
+    }
+    for (int x = -lo; x + hi < width; x++) {
+      /* Row of the piece origin once dropped, counted from the top. */
+      int land = height;
+      for (int i = 0; i < 4; i++) {
+        int y = height-1 - colHeight[x + cells[i][0]] - cells[i][1];
+        if (y < land) land = y;
+      }
+      int top = 0, holes = 0;
+      for (int i = 0; i < 4; i++) {
+        int cellHeight = height - (land + cells[i][1]);
+        if (cellHeight > top) top = cellHeight;
+        bool lowest = true;
+        for (int j = 0; j < 4; j++)
+          if (cells[j][0] == cells[i][0] && cells[j][1] > cells[i][1]) lowest = false;
+        if (lowest) holes += cellHeight - 1 - colHeight[x + cells[i][0]];
+      }
+      if (top < bestTop || (top == bestTop && holes < bestHoles)) {
+        bestTop = top; bestHoles = holes; *bestRot = rot; *bestX = x;
+      }
+    }
+  }
+}
+
+int main(void) {
+  char ruleset[64];
+  while (fgets(line, sizeof line, stdin)) {
+    if (sscanf(line, "rules %d %d %63s", &width, &height, ruleset) == 3) {
+      if (width > MAX_BOARD_COLS - 2) width = MAX_BOARD_COLS - 2;
+      printf("ready refbot\n");
+      fflush(stdout);
+    } else if (strncmp(line, "suggest ", 8) == 0) {
+      int lane, offset = 0, rot, x;
+      char piece;
+      if (sscanf(line, "suggest %d %c %*s %n", &lane, &piece, &offset) < 2 || !offset) continue;
+      ReadBoard(line + offset);
+      int t = PieceFromLetter(piece);
+      if (t < 0) continue;
+      Choose(t, &rot, &x);
+      printf("place %d %d %d\n", lane, rot, x);
+      fflush(stdout);
+    } else if (strncmp(line, "quit", 4) == 0) {
+      break;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,363 @@
+/* Programmed by edutavr */
+
+#include "replay.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ===================== FORMAT ===================== */
+
+/* File layout, little-endian:
+     "RBRP", version u8, ruleset u8, startLevel u16, cols u16, rows u16,
+     previews u8, seed u64, das u8, arr u8, sdArr u8
+     per input change: ticks since the previous change (LEB128), input u8
+     end: ticks since the last change (LEB128), REPLAY_END, hash u64, score u32
+   Input bits fit in 6 bits, so REPLAY_END can't be mistaken for an input. */
+
+#define REPLAY_MAGIC        "RBRP"
+#define REPLAY_HEADER_BYTES 24
+#define REPLAY_END          0xFF
+#define VARINT_MAX_BYTES    5
+
+static int PutVarint(unsigned char *out, uint32_t v) {
+  int n = 0;
+  while (v >= 0x80) { out[n++] = (unsigned char)(v | 0x80); v >>= 7; }
+  out[n++] = (unsigned char)v;
+  return n;
+}
+
+static void PutLE(unsigned char *out, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) out[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t GetLE(const unsigned char *in, int bytes) {
+  uint64_t v = 0;
+  for (int i = 0; i < bytes; i++) v |= (uint64_t)in[i] << (8 * i);
+  return v;
+}
+
+_Static_assert(MAX_HANDLING_TICKS <= 0xFF, "handling is stored in one byte");
+
+/* Clamped the way GameSetHandling does, so the file holds the handling the
+   game actually ran with. */
+static unsigned char HandlingByte(int ticks) {
+  return (unsigned char)(ticks < 0 ? 0 : ticks > MAX_HANDLING_TICKS ? MAX_HANDLING_TICKS : ticks);
+}
+
+/* ===================== RECORDING ===================== */
+
+/* Single producer (the game thread), single consumer (the writer). head and
+   tail only ever grow; the buffer is indexed by their low bits. */
+#define REPLAY_BUFFER_BYTES (1 << 16)
+#define REPLAY_BUFFER_MASK  (REPLAY_BUFFER_BYTES - 1)
+#define REPLAY_FLUSH_MS     250   /* writer wake-up period while the game runs */
+
+struct ReplayRecorder {
+  FILE           *file;
+  pthread_t       thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  wake;
+  bool            closing;   /* under lock */
+
+  _Atomic uint32_t head;     /* bytes queued by the game thread */
+  _Atomic uint32_t tail;     /* bytes written out by the writer */
+
+  uint32_t tick;             /* ticks recorded */
+  uint32_t lastChangeTick;
+  unsigned lastInput;
+
+  unsigned char buffer[REPLAY_BUFFER_BYTES];
+};
+
+/* Only waits if the writer has fallen a whole buffer behind. */
+static void QueueBytes(ReplayRecorder *r, const unsigned char *bytes, int n) {
+  uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  while (head + (uint32_t)n - atomic_load_explicit(&r->tail, memory_order_acquire) > REPLAY_BUFFER_BYTES)
+    sched_yield();
+  for (int i = 0; i < n; i++) r->buffer[(head + (uint32_t)i) & REPLAY_BUFFER_MASK] = bytes[i];
+  atomic_store_explicit(&r->head, head + (uint32_t)n, memory_order_release);
+}
+
+/* Writes out everything queued so far, in at most two pieces. */
+static void WriteQueued(ReplayRecorder *r) {
+  uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+  if (head == tail) return;
+  uint32_t start = tail & REPLAY_BUFFER_MASK, count = head - tail;
+  uint32_t first = count < REPLAY_BUFFER_BYTES - start ? count : REPLAY_BUFFER_BYTES - start;
+  fwrite(r->buffer + start, 1, first, r->file);
+  if (count > first) fwrite(r->buffer, 1, count - first, r->file);
+  fflush(r->file);
+  atomic_store_explicit(&r->tail, head, memory_order_release);
+}
+
+static void *ReplayWriterMain(void *arg) {
+  ReplayRecorder *r = arg;
+  bool closing = false;
+  while (!closing) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += REPLAY_FLUSH_MS * 1000000L;
+    if (until.tv_nsec >= 1000000000L) { until.tv_sec++; until.tv_nsec -= 1000000000L; }
+    pthread_mutex_lock(&r->lock);
+    if (!r->closing) pthread_cond_timedwait(&r->wake, &r->lock, &until);
+    closing = r->closing;
+    pthread_mutex_unlock(&r->lock);
+    WriteQueued(r);
+  }
+  return NULL;
+}
+
+ReplayRecorder *ReplayRecordStart(const char *path, const ReplayHeader *header) {
+  ReplayRecorder *r = calloc(1, sizeof *r);
+  if (!r) return NULL;
+  r->file = fopen(path, "wb");
+  if (!r->file) { free(r); return NULL; }
+  pthread_mutex_init(&r->lock, NULL);
+  pthread_cond_init(&r->wake, NULL);
+  atomic_init(&r->head, 0);
+  atomic_init(&r->tail, 0);
+
+  unsigned char h[REPLAY_HEADER_BYTES];
+  memcpy(h, REPLAY_MAGIC, 4);
+  h[4] = REPLAY_VERSION;
+  h[5] = (unsigned char)header->ruleset;
+  PutLE(h + 6,  (uint64_t)header->startLevel, 2);
+  PutLE(h + 8,  (uint64_t)header->cols, 2);
+  PutLE(h + 10, (uint64_t)header->rows, 2);
+  h[12] = (unsigned char)header->previews;
+  PutLE(h + 13, header->seed, 8);
+  h[21] = HandlingByte(header->das);
+  h[22] = HandlingByte(header->arr);
+  h[23] = HandlingByte(header->sdArr);
+  QueueBytes(r, h, REPLAY_HEADER_BYTES);
+
+  if (pthread_create(&r->thread, NULL, ReplayWriterMain, r) != 0) {
+    fclose(r->file);
+    remove(path);
+    pthread_cond_destroy(&r->wake);
+    pthread_mutex_destroy(&r->lock);
+    free(r);
+    return NULL;
+  }
+  return r;
+}
+
+/* A few bytes into memory, and only when the buttons changed. */
+void ReplayRecordTick(ReplayRecorder *r, unsigned input) {
+  if (input != r->lastInput) {
+    unsigned char rec[VARINT_MAX_BYTES + 1];
+    int n = PutVarint(rec, r->tick - r->lastChangeTick);
+    rec[n++] = (unsigned char)input;
+    QueueBytes(r, rec, n);
+    r->lastInput      = input;
+    r->lastChangeTick = r->tick;
+  }
+  r->tick++;
+}
+
+void ReplayRecordFinish(ReplayRecorder *r, const GameState *g) {
+  unsigned char end[VARINT_MAX_BYTES + 1 + 8 + 4];
+  int n = PutVarint(end, r->tick - r->lastChangeTick);
+  end[n++] = REPLAY_END;
+  PutLE(end + n, GameHash(g), 8);                  n += 8;
+  PutLE(end + n, (uint32_t)GameScore(g), 4);       n += 4;
+  QueueBytes(r, end, n);
+
+  pthread_mutex_lock(&r->lock);
+  r->closing = true;
+  pthread_cond_signal(&r->wake);
+  pthread_mutex_unlock(&r->lock);
+  pthread_join(r->thread, NULL);
+
+  fclose(r->file);
+  pthread_cond_destroy(&r->wake);
+  pthread_mutex_destroy(&r->lock);
+  free(r);
+}
+
+/* ===================== LOADING ===================== */
+
+static bool GetVarint(const unsigned char **p, const unsigned char *end, uint32_t *out) {
+  uint32_t v = 0;
+  for (int shift = 0; shift < 7 * VARINT_MAX_BYTES && *p < end; shift += 7) {
+    unsigned char b = *(*p)++;
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) { *out = v; return true; }
+  }
+  return false;
+}
+
+bool ReplayLoad(const char *path, Replay *out) {
+  memset(out, 0, sizeof *out);
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  unsigned char *data = size >= REPLAY_HEADER_BYTES ? malloc((size_t)size) : NULL;
+  bool ok = data && fread(data, 1, (size_t)size, f) == (size_t)size;
+  fclose(f);
+  if (!ok || memcmp(data, REPLAY_MAGIC, 4) != 0 || data[4] != REPLAY_VERSION || data[5] >= RULESET_COUNT) {
+    free(data);
+    return false;
+  }
+
+  ReplayHeader *h = &out->header;
+  h->ruleset    = (RulesetId)data[5];
+  h->startLevel = (int)GetLE(data + 6, 2);
+  h->cols       = (int)GetLE(data + 8, 2);
+  h->rows       = (int)GetLE(data + 10, 2);
+  h->previews   = data[12];
+  h->seed       = GetLE(data + 13, 8);
+  h->das        = data[21];
+  h->arr        = data[22];
+  h->sdArr      = data[23];
+
+  /* A cut-short file keeps every change read before the damage. */
+  const unsigned char *p = data + REPLAY_HEADER_BYTES, *end = data + size;
+  int capacity = 0;
+  uint32_t tick = 0, delta;
+  while (GetVarint(&p, end, &delta) && p < end) {
+    uint8_t input = *p++;
+    tick += delta;
+    if (input == REPLAY_END) {
+      if (end - p >= 12) {
+        out->complete   = true;
+        out->finalHash  = GetLE(p, 8);
+        out->finalScore = (int)GetLE(p + 8, 4);
+      }
+      break;
+    }
+    if (out->changeCount == capacity) {
+      int grown = capacity ? capacity * 2 : 256;
+      ReplayChange *c = realloc(out->changes, (size_t)grown * sizeof *c);
+      if (!c) break;
+      out->changes = c;
+      capacity = grown;
+    }
+    out->changes[out->changeCount++] = (ReplayChange){ tick, input };
+  }
+  out->tickCount = tick;
+  free(data);
+  return true;
+}
+
+void ReplayFree(Replay *r) {
+  free(r->changes);
+  memset(r, 0, sizeof *r);
+}
+
+/* ===================== PLAYBACK ===================== */
+
+#define KEYFRAME_TICKS        (10 * SIM_TICK_RATE)  /* shortest gap between keyframes */
+#define KEYFRAME_BUDGET_BYTES ((size_t)64 << 20)    /* the gap widens on replays that would need more */
+
+struct ReplayPlayer {
+  Replay     replay;
+  GameState *game;
+  GameStepFn step;            /* GameStepFor the replay's ruleset */
+  uint32_t   tick;            /* ticks played so far */
+  int        nextChange;      /* first change not applied yet */
+  unsigned   input;           /* held since the last applied change */
+  bool       verified;
+
+  uint32_t       keyframeTicks;
+  int            keyframeCount;
+  size_t         keyframeStride;  /* snapshot size rounded up to keep each one aligned */
+  unsigned char *keyframes;   /* the k-th was taken at tick k * keyframeTicks */
+};
+
+static unsigned PlayerStep(ReplayPlayer *p) {
+  const Replay *r = &p->replay;
+  while (p->nextChange < r->changeCount && r->changes[p->nextChange].tick <= p->tick)
+    p->input = r->changes[p->nextChange++].input;
+  p->step(p->game, p->input);
+  p->tick++;
+  return GameEvents(p->game);
+}
+
+/* Puts the player on keyframe k: its game, and the changes up to its tick. */
+static void PlayerRestoreKeyframe(ReplayPlayer *p, int k) {
+  const Replay *r = &p->replay;
+  GameRestore(p->game, p->keyframes + (size_t)k * p->keyframeStride);
+  p->tick = (uint32_t)k * p->keyframeTicks;
+  int lo = 0, hi = r->changeCount;  /* first change at or after tick */
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (r->changes[mid].tick < p->tick) lo = mid + 1;
+    else                                hi = mid;
+  }
+  p->nextChange = lo;
+  p->input      = lo > 0 ? r->changes[lo - 1].input : 0;
+}
+
+ReplayPlayer *ReplayPlayerOpen(const char *path) {
+  ReplayPlayer *p = calloc(1, sizeof *p);
+  if (!p) return NULL;
+  if (!ReplayLoad(path, &p->replay)) { free(p); return NULL; }
+  const ReplayHeader *h = &p->replay.header;
+  p->game = GameCreate(h->cols, h->rows);
+  if (!p->game || GameCols(p->game) != h->cols || GameRows(p->game) != h->rows) {
+    ReplayPlayerClose(p);
+    return NULL;
+  }
+  GameSetPreviews(p->game, h->previews);
+  GameSetHandling(p->game, h->das, h->arr, h->sdArr);
+  GameInit(p->game, h->seed, h->ruleset, h->startLevel);
+  p->step = GameStepFor(h->ruleset);
+
+  /* Keyframes every KEYFRAME_TICKS, or sparser if that would break the budget. */
+  uint32_t length = p->replay.tickCount;
+  p->keyframeStride = (GameSnapshotSize(p->game) + 15) & ~(size_t)15;
+  size_t budget     = KEYFRAME_BUDGET_BYTES / p->keyframeStride;
+  if (budget < 2) budget = 2;
+  p->keyframeTicks = KEYFRAME_TICKS;
+  if (length / p->keyframeTicks + 1 > budget) p->keyframeTicks = length / (uint32_t)(budget - 1) + 1;
+  p->keyframeCount = (int)(length / p->keyframeTicks) + 1;
+  p->keyframes     = malloc((size_t)p->keyframeCount * p->keyframeStride);
+  if (!p->keyframes) { ReplayPlayerClose(p); return NULL; }
+
+  for (int k = 0; k < p->keyframeCount; k++) {
+    while (p->tick < (uint32_t)k * p->keyframeTicks) PlayerStep(p);
+    GameSnapshot(p->game, p->keyframes + (size_t)k * p->keyframeStride);
+  }
+  while (p->tick < length) PlayerStep(p);
+  p->verified = p->replay.complete && GameHash(p->game) == p->replay.finalHash
+                && GameScore(p->game) == p->replay.finalScore;
+
+  PlayerRestoreKeyframe(p, 0);
+  return p;
+}
+
+void ReplayPlayerClose(ReplayPlayer *p) {
+  if (!p) return;
+  GameDestroy(p->game);
+  free(p->keyframes);
+  ReplayFree(&p->replay);
+  free(p);
+}
+
+unsigned ReplayPlayerAdvance(ReplayPlayer *p, uint32_t ticks) {
+  unsigned events = 0;
+  for (uint32_t i = 0; i < ticks && p->tick < p->replay.tickCount; i++) events |= PlayerStep(p);
+  return events;
+}
+
+/* Going forward within the same keyframe gap just keeps playing. */
+void ReplayPlayerSeek(ReplayPlayer *p, uint32_t tick) {
+  if (tick > p->replay.tickCount) tick = p->replay.tickCount;
+  int k = (int)(tick / p->keyframeTicks);
+  if (tick < p->tick || (uint32_t)k * p->keyframeTicks > p->tick) PlayerRestoreKeyframe(p, k);
+  while (p->tick < tick) PlayerStep(p);
+}
+
+const GameState    *ReplayPlayerGame(const ReplayPlayer *p)     { return p->game; }
+const ReplayHeader *ReplayPlayerHeader(const ReplayPlayer *p)   { return &p->replay.header; }
+uint32_t ReplayPlayerTick(const ReplayPlayer *p)                { return p->tick; }
+uint32_t ReplayPlayerLength(const ReplayPlayer *p)              { return p->replay.tickCount; }
+bool     ReplayPlayerVerified(const ReplayPlayer *p)            { return p->verified; }
@@ -0,0 +1,92 @@
+/* Programmed by edutavr */
+
+/* Replays. The engine is deterministic, so a game is fully described by its
+   seed, ruleset and settings plus the InputBits held on every tick. A
+   replay file stores exactly that, and of the input only the ticks where it
+   changed. Recording runs on the game thread without touching the disk: the
+   bytes go through a ring buffer to a writer thread. */
+
+#ifndef RAYBLOCKS_REPLAY_H
+#define RAYBLOCKS_REPLAY_H
+
+#include "engine.h"
+
+#define REPLAY_VERSION 2
+
+/* Everything needed to set the game up again (GameCreate, GameSetPreviews,
+   GameSetHandling, GameInit). cols/rows include the walls and the floor row. */
+typedef struct ReplayHeader {
+  uint64_t  seed;
+  RulesetId ruleset;
+  int       startLevel;
+  int       cols;
+  int       rows;
+  int       previews;
+  int       das;
+  int       arr;
+  int       sdArr;
+} ReplayHeader;
+
+/* ===================== RECORDING ===================== */
+
+typedef struct ReplayRecorder ReplayRecorder;
+
+/* Creates path and starts its writer thread; NULL if either fails. */
+ReplayRecorder *ReplayRecordStart(const char *path, const ReplayHeader *header);
+
+/* The input of the next tick; call once per GameStep, with the same bits. */
+void ReplayRecordTick(ReplayRecorder *r, unsigned input);
+
+/* Ends the file with the final position's hash and score (so a viewer can
+   check it reproduced the game), waits for the writer and frees r. */
+void ReplayRecordFinish(ReplayRecorder *r, const GameState *g);
+
+/* ===================== LOADING ===================== */
+
+/* From this tick on, input is held until the next change. */
+typedef struct ReplayChange {
+  uint32_t tick;
+  uint8_t  input;
+} ReplayChange;
+
+typedef struct Replay {
+  ReplayHeader  header;
+  ReplayChange *changes;
+  int           changeCount;
+  uint32_t      tickCount;
+  bool          complete;     /* the file was finished; false if it was cut short */
+  uint64_t      finalHash;    /* GameHash after tickCount ticks, if complete */
+  int           finalScore;
+} Replay;
+
+/* False if path can't be read or isn't a replay this version can play. */
+bool ReplayLoad(const char *path, Replay *out);
+void ReplayFree(Replay *r);
+
+/* ===================== PLAYBACK ===================== */
+
+/* A loaded replay played back into its own game, with a snapshot of the
+   game kept every few seconds so any tick can be reached from the nearest
+   one instead of from the start. */
+typedef struct ReplayPlayer ReplayPlayer;
+
+/* Loads path and plays it through once to take the keyframes; NULL if the
+   file can't be played. The player starts at tick 0. */
+ReplayPlayer *ReplayPlayerOpen(const char *path);
+void          ReplayPlayerClose(ReplayPlayer *p);
+
+/* Plays up to ticks more ticks, stopping at the end; returns the GameEvent
+   bits they raised. */
+unsigned ReplayPlayerAdvance(ReplayPlayer *p, uint32_t ticks);
+
+/* Jumps to tick (clamped to the length): the nearest keyframe at or before
+   it, then the ticks in between. */
+void ReplayPlayerSeek(ReplayPlayer *p, uint32_t tick);
+
+const GameState    *ReplayPlayerGame(const ReplayPlayer *p);
+const ReplayHeader *ReplayPlayerHeader(const ReplayPlayer *p);
+uint32_t ReplayPlayerTick(const ReplayPlayer *p);    /* ticks played so far */
+uint32_t ReplayPlayerLength(const ReplayPlayer *p);  /* ticks in the replay */
+bool     ReplayPlayerVerified(const ReplayPlayer *p);  /* the end matched the recorded hash and score */
+
+#endif